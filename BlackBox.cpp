@@ -0,0 +1,448 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Black Box
+//  Class:      C++ Source
+//  Filename:   BlackBox.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include "BlackBox.h"
+
+CBlackBox::CBlackBox(CRecordWriter& Writer, CContainerWriter& Container)
+   : mWriter(Writer), mContainer(Container)
+{
+   mActive = -1;
+   mSegmentBytes = 0;
+   mSequence = 0;
+   mReuses = 0;
+   mLastManifest = 0.0;
+   mManifestFailed = false;
+   mManifestRunning = false;
+   mManifestVersion = 0;
+   mSavedVersion = 0;
+}
+
+CBlackBox::~CBlackBox()
+{
+   StopManifestThread();
+}
+
+// Creates and preallocates every segment in the current directory, then
+// starts the first.  Whatever an earlier black box left there is discarded.
+// The segments are made smaller if need be to keep MIN_SEGMENTS of them
+// within TotalBytes.
+bool CBlackBox::Open(uint64_t TotalBytes, uint64_t SegmentBytes)
+{
+   int num_segments;
+
+   mSegmentBytes = std::min(SegmentBytes, TotalBytes / MIN_SEGMENTS) & ~(uint64_t)(CRecordWriter::DIRECT_ALIGN - 1);
+
+   if (mSegmentBytes < MIN_SEGMENT_BYTES)
+   {
+      fprintf(stderr, "CBlackBox::Open(): %lu bytes is too small, the black box needs at least %d segments of %lu bytes\n",
+         TotalBytes, MIN_SEGMENTS, MIN_SEGMENT_BYTES);
+      return false;
+   }
+
+   num_segments = TotalBytes / mSegmentBytes;
+
+   mSegments.resize(num_segments);
+
+   for (int i = 0; i < num_segments; i++)
+   {
+      TBlackBoxSegment& segment = mSegments[i];
+      char              filename[32];
+
+      snprintf(filename, sizeof(filename), "blackbox_%03d.seg", i);
+
+      segment.filename = filename;
+      segment.file     = mWriter.OpenFile(filename, mSegmentBytes);
+      segment.sequence = 0;
+      segment.state    = SEGMENT_EMPTY;
+      segment.bytes    = 0;
+      segment.end      = 0;
+
+      if (segment.file < 0)
+         return false;
+   }
+
+   // nothing is valid until it is written
+   if (!WriteManifest())
+      return false;
+
+   Rotate(0.0);
+
+   mManifestRunning = true;
+   mManifestThread = std::thread(&CBlackBox::ManifestThread, this);
+
+   return true;
+}
+
+void CBlackBox::StopManifestThread()
+{
+   if (!mManifestThread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> lock(mManifestLock);
+
+      mManifestRunning = false;
+   }
+
+   mManifestReady.notify_one();
+   mManifestThread.join();
+}
+
+// Closes the active container and waits for everything to reach the file,
+// so the final manifest covers all of it
+void CBlackBox::Close()
+{
+   if (mActive < 0)
+      return;
+
+   TBlackBoxSegment& segment = mSegments[mActive];
+
+   mContainer.Close();
+   segment.end    = mWriter.GetOffset(segment.file);
+   segment.chunks = mContainer.GetChunks();
+   segment.state  = SEGMENT_CLOSED;
+   mActive = -1;
+
+   mWriter.Submit(true);
+
+   while (mWriter.GetInFlight() > 0)
+      mWriter.Reap(true);
+
+   StopManifestThread();
+
+   if (!WriteManifest())
+      perror("CBlackBox::Close(): could not write the manifest");
+}
+
+void CBlackBox::Append(TPacketRecord* Record, double Now)
+{
+   if (!mContainer.Fits(Record, mSegmentBytes))
+      Rotate(Now);
+
+   TBlackBoxSegment& segment = mSegments[mActive];
+
+   if (isnan(segment.real_offset))
+      segment.real_offset = Record->header.real_time - Record->header.time;
+
+   mContainer.Append(Record, Now);
+}
+
+// Keeps the manifest up to date with what has been written
+void CBlackBox::Service(double Now)
+{
+   if (Now - mLastManifest >= MANIFEST_INTERVAL)
+   {
+      std::string text;
+
+      FormatManifest(text);
+
+      {
+         std::lock_guard<std::mutex> lock(mManifestLock);
+
+         mManifestVersion++;
+         mPendingManifest.swap(text);
+      }
+
+      mManifestReady.notify_one();
+      mLastManifest = Now;
+   }
+}
+
+// Closes the active segment and starts the oldest one over.  The manifest
+// drops the oldest before any of it is overwritten.
+void CBlackBox::Rotate(double Now)
+{
+   int next = (mActive + 1) % mSegments.size();
+
+   if (mActive >= 0)
+   {
+      TBlackBoxSegment& segment = mSegments[mActive];
+
+      mContainer.Close();
+      segment.end    = mWriter.GetOffset(segment.file);
+      segment.chunks = mContainer.GetChunks();
+      segment.state  = SEGMENT_CLOSED;
+   }
+
+   TBlackBoxSegment& segment = mSegments[next];
+
+   if (segment.state != SEGMENT_EMPTY)
+   {
+      segment.state = SEGMENT_EMPTY;
+
+      // the old manifest still lists the segment about to be overwritten
+      if (!WriteManifest())
+         perror("CBlackBox::Rotate(): could not write the manifest");
+
+      mLastManifest = Now;
+      mReuses++;
+   }
+
+   mWriter.Rewind(segment.file);
+   mContainer.Open(segment.file);
+
+   segment.sequence    = ++mSequence;
+   segment.state       = SEGMENT_ACTIVE;
+   segment.bytes       = 0;
+   segment.end         = 0;
+   segment.real_offset = NAN;
+   segment.chunks.clear();
+
+   mActive = next;
+}
+
+// Works out how much of a segment has been written and the times of the
+// chunks that lie entirely within it
+void CBlackBox::Update(TBlackBoxSegment& Segment)
+{
+   const std::vector<TChunkIndexEntry>& chunks = (Segment.state == SEGMENT_ACTIVE) ? mContainer.GetChunks() : Segment.chunks;
+   uint64_t                             end = (Segment.state == SEGMENT_ACTIVE) ? mWriter.GetOffset(Segment.file) : Segment.end;
+
+   Segment.first_time = HUGE_VAL;
+   Segment.last_time  = -HUGE_VAL;
+
+   if (Segment.state == SEGMENT_EMPTY)
+   {
+      Segment.bytes = 0;
+      return;
+   }
+
+   Segment.bytes = std::min(mWriter.GetCompleted(Segment.file), end);
+
+   // chunks go into the file in index order, each ends where the next starts
+   for (size_t i = 0; i < chunks.size(); i++)
+   {
+      uint64_t chunk_end = (i + 1 < chunks.size()) ? chunks[i + 1].offset : end;
+
+      if (chunk_end > Segment.bytes)
+         break;
+
+      Segment.first_time = std::min(Segment.first_time, chunks[i].first_time);
+      Segment.last_time  = std::max(Segment.last_time, chunks[i].last_time);
+   }
+}
+
+// Appends one printf formatted line of the manifest
+static void append_line(std::string& Text, const char* Format, ...)
+{
+   char    line[256];
+   va_list args;
+
+   va_start(args, Format);
+   vsnprintf(line, sizeof(line), Format, args);
+   va_end(args);
+
+   Text += line;
+}
+
+// Describes what the segments hold as of now, on the writer thread
+void CBlackBox::FormatManifest(std::string& Text)
+{
+   std::vector<TBlackBoxSegment*> segments;
+
+   for (auto& segment : mSegments)
+   {
+      Update(segment);
+
+      if (segment.state != SEGMENT_EMPTY)
+         segments.push_back(&segment);
+   }
+
+   std::sort(segments.begin(), segments.end(),
+      [](const TBlackBoxSegment* A, const TBlackBoxSegment* B) { return A->sequence < B->sequence; });
+
+   Text.clear();
+   append_line(Text, "# black box manifest, segments oldest first\n");
+   append_line(Text, "# segment <file> <sequence> <state> <valid bytes> <first time> <last time>\n");
+
+   const TBlackBoxSegment* first = nullptr;
+   const TBlackBoxSegment* last = nullptr;
+
+   for (const TBlackBoxSegment* segment : segments)
+   {
+      bool has_data = segment->first_time <= segment->last_time;
+
+      append_line(Text, "segment %s %lu %s %lu %.6f %.6f\n", segment->filename.c_str(), segment->sequence,
+         segment->state == SEGMENT_ACTIVE ? "active" : "closed", segment->bytes,
+         has_data ? segment->first_time : 0.0, has_data ? segment->last_time : 0.0);
+
+      if (has_data)
+      {
+         if (!first)
+            first = segment;
+         last = segment;
+      }
+   }
+
+   // recorded times, then the same as real times
+   if (first)
+      append_line(Text, "window %.6f %.6f %.6f %.6f\n", first->first_time, last->last_time,
+         first->first_time + first->real_offset, last->last_time + last->real_offset);
+   else
+      append_line(Text, "window none\n");
+}
+
+// Replaces the manifest with Text through a rename.  The contents reach the
+// disk before the rename does, and the rename before the directory sync
+// returns.
+bool CBlackBox::SaveManifest(const std::string& Text)
+{
+   std::string temp_name = std::string(GetManifestName()) + ".tmp";
+   FILE*       file = fopen(temp_name.c_str(), "w");
+   bool        status;
+
+   if (!file)
+      return false;
+
+   status = (fwrite(Text.data(), 1, Text.size(), file) == Text.size());
+   status = (fflush(file) == 0) && status;
+   status = status && (fsync(fileno(file)) == 0);
+   status = (fclose(file) == 0) && status;
+
+   if (!status || rename(temp_name.c_str(), GetManifestName()) != 0)
+      return false;
+
+   int directory = open(".", O_RDONLY | O_DIRECTORY);
+
+   if (directory < 0)
+      return false;
+
+   status = (fsync(directory) == 0);
+   close(directory);
+
+   return status;
+}
+
+// Writes the manifest before returning, for Open, Close and before a segment
+// is reused.  It supersedes any update still waiting for the manifest thread.
+bool CBlackBox::WriteManifest()
+{
+   std::string text;
+   uint64_t    version;
+
+   FormatManifest(text);
+
+   {
+      std::lock_guard<std::mutex> lock(mManifestLock);
+
+      version = ++mManifestVersion;
+      mPendingManifest.clear();
+   }
+
+   std::lock_guard<std::mutex> lock(mSaveLock);
+
+   mSavedVersion = version;
+
+   return SaveManifest(text);
+}
+
+// Saves the updates Service queues, so the file creation and syncs stay off
+// the writer thread.  Only the latest update is kept if it falls behind.
+void CBlackBox::ManifestThread()
+{
+   std::unique_lock<std::mutex> lock(mManifestLock);
+
+   while (mManifestRunning)
+   {
+      mManifestReady.wait(lock, [this] { return !mManifestRunning || !mPendingManifest.empty(); });
+
+      if (mPendingManifest.empty())
+         continue;
+
+      std::string text;
+      uint64_t    version = mManifestVersion;
+
+      text.swap(mPendingManifest);
+      lock.unlock();
+
+      {
+         std::lock_guard<std::mutex> save_lock(mSaveLock);
+
+         // a synchronous write may have overtaken this one
+         if (version > mSavedVersion)
+         {
+            bool status = SaveManifest(text);
+
+            // report once rather than every interval
+            if (!status && !mManifestFailed)
+               perror("CBlackBox: could not write the manifest");
+
+            mManifestFailed = !status;
+            mSavedVersion = version;
+         }
+      }
+
+      lock.lock();
+   }
+}
+
+// Reads the manifest of the black box in Directory, if it has one.  The
+// segment filenames include the directory.
+bool CBlackBox::LoadManifest(const std::string& Directory, std::vector<TBlackBoxSegment>& Segments)
+{
+   FILE* file = fopen((Directory + "/" + GetManifestName()).c_str(), "r");
+   char  line[512];
+
+   Segments.clear();
+
+   if (!file)
+      return false;
+
+   while (fgets(line, sizeof(line), file))
+   {
+      TBlackBoxSegment segment;
+      char             filename[256];
+      char             state[16];
+
+      if (sscanf(line, "segment %255s %lu %15s %lu %lf %lf", filename, &segment.sequence, state,
+                 &segment.bytes, &segment.first_time, &segment.last_time) != 6)
+      {
+         continue;
+      }
+
+      segment.filename    = Directory + "/" + filename;
+      segment.file        = -1;
+      segment.state       = (strcmp(state, "active") == 0) ? SEGMENT_ACTIVE : SEGMENT_CLOSED;
+      segment.end         = segment.bytes;
+      segment.real_offset = NAN;
+
+      Segments.push_back(segment);
+   }
+
+   fclose(file);
+
+   return true;
+}
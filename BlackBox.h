@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Black Box
+//  Class:      C++ Header
+//  Filename:   BlackBox.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CBlackBox
+//! \brief Rolling recording kept in a fixed set of reused segment files
+//!
+//! The black box holds the last TotalBytes of traffic in segment files of
+//! SegmentBytes each (blackbox_NNN.seg), every one a session container.  The
+//! segments are made smaller when TotalBytes would not hold MIN_SEGMENTS of
+//! them, so they never take more than TotalBytes.  All the segments are
+//! created and preallocated with fallocate by Open, so the recording never
+//! creates a file or grows one.  When the record being
+//! appended would take the active segment past its size the container is
+//! closed and the oldest segment is started over in place.
+//!
+//! blackbox.manifest describes what the segments hold, oldest first: each
+//! segment's sequence number, the bytes of it that have been written (a
+//! reader must look no further, the rest is stale), and the recorded times
+//! they cover, then the time window of the whole black box.  It is rewritten
+//! through a rename, so it never claims data that is not on disk.  Before a
+//! segment is reused the writer thread waits for that.  The once a second
+//! updates are only formatted on the writer thread, a manifest thread does
+//! the file work and syncs so the writer does not stall on them.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Container.h"
+#include "RecordWriter.h"
+
+enum eSegmentState {SEGMENT_EMPTY, SEGMENT_ACTIVE, SEGMENT_CLOSED};
+
+struct TBlackBoxSegment
+{
+   std::string                   filename;   // in the black box directory
+   int                           file;       // in the record writer
+   uint64_t                      sequence;   // counts up from 1 as segments are started
+   eSegmentState                 state;
+   uint64_t                      bytes;      // valid bytes
+   uint64_t                      end;        // container size once closed
+   double                        first_time; // recorded time of the valid data
+   double                        last_time;
+   double                        real_offset; // real_time - time when the segment started
+   std::vector<TChunkIndexEntry> chunks;     // of a closed container
+};
+
+class CBlackBox
+{
+public:
+   static constexpr uint64_t MIN_SEGMENT_BYTES = 1024 * 1024;
+   static constexpr int      MIN_SEGMENTS      = 2;
+   static constexpr double   MANIFEST_INTERVAL = 1.0;
+
+   CBlackBox(CRecordWriter& Writer, CContainerWriter& Container);
+   ~CBlackBox();
+
+   CBlackBox(const CBlackBox&) = delete;
+   CBlackBox& operator=(const CBlackBox&) = delete;
+
+   bool Open(uint64_t TotalBytes, uint64_t SegmentBytes);
+   void Close();
+
+   void Append(TPacketRecord* Record, double Now);
+   void Service(double Now);
+
+   int      GetNumSegments() const { return (int)mSegments.size(); }
+   uint64_t GetSegmentBytes() const { return mSegmentBytes; }
+   uint64_t GetReuses() const { return mReuses; }
+
+   static const char* GetManifestName() { return "blackbox.manifest"; }
+   static bool        LoadManifest(const std::string& Directory, std::vector<TBlackBoxSegment>& Segments);
+
+private:
+   void Rotate(double Now);
+   void Update(TBlackBoxSegment& Segment);
+   void FormatManifest(std::string& Text);
+   bool WriteManifest();
+   void ManifestThread();
+   void StopManifestThread();
+
+   static bool SaveManifest(const std::string& Text);
+
+   CRecordWriter&                mWriter;
+   CContainerWriter&             mContainer;
+   std::vector<TBlackBoxSegment> mSegments;
+   int                           mActive;     // segment being written, -1 before Open and after Close
+   uint64_t                      mSegmentBytes;
+   uint64_t                      mSequence;
+   uint64_t                      mReuses;     // segments started over
+   double                        mLastManifest;
+
+   // periodic manifest updates, saved by the manifest thread
+   std::thread                   mManifestThread;
+   std::mutex                    mManifestLock;   // guards the next three
+   std::condition_variable       mManifestReady;
+   bool                          mManifestRunning;
+   std::string                   mPendingManifest; // empty once taken
+   uint64_t                      mManifestVersion; // of the latest update made
+   std::mutex                    mSaveLock;       // held while the file is written
+   uint64_t                      mSavedVersion;
+   bool                          mManifestFailed; // last update the thread saved failed
+};
@@ -0,0 +1,372 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Container
+//  Class:      C++ Source
+//  Filename:   Container.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "Container.h"
+
+CContainerWriter::CContainerWriter(CRecordWriter& Writer)
+   : mWriter(Writer)
+{
+   mFile = -1;
+   mOpenBytes = 0;
+   mOpenChunks = 0;
+}
+
+CContainerWriter::~CContainerWriter()
+{
+}
+
+bool CContainerWriter::Open(const char* Filename)
+{
+   int file = mWriter.OpenFile(Filename);
+
+   if (file < 0)
+      return false;
+
+   Open(file);
+
+   return true;
+}
+
+// Starts a new container at the current offset of File, which must be
+// open in the record writer.  Streams are defined again in every container.
+void CContainerWriter::Open(int File)
+{
+   TRecordFileHeader header;
+
+   mFile = File;
+   mStreamIds.clear();
+   mStreams.clear();
+   mIndex.clear();
+   mOpenBytes = 0;
+   mOpenChunks = 0;
+
+   memcpy(header.magic, CONTAINER_MAGIC, sizeof(header.magic));
+   header.version     = CONTAINER_VERSION;
+   header.header_size = sizeof(header);
+
+   mWriter.Append(mFile, &header, sizeof(header));
+}
+
+// Closes every open chunk and writes the stream table and chunk index
+void CContainerWriter::Close()
+{
+   TContainerTrailer trailer;
+
+   if (mFile < 0)
+      return;
+
+   for (size_t i = 0; i < mStreams.size(); i++)
+      CloseChunk(mStreams[i]);
+
+   trailer.streams_offset = mWriter.GetOffset(mFile);
+   trailer.num_streams = mStreams.size();
+
+   for (size_t i = 0; i < mStreams.size(); i++)
+      mWriter.Append(mFile, &mStreams[i].stream, sizeof(TContainerStream));
+
+   trailer.chunks_offset = mWriter.GetOffset(mFile);
+   trailer.num_chunks = mIndex.size();
+
+   if (!mIndex.empty())
+      mWriter.Append(mFile, mIndex.data(), mIndex.size() * sizeof(TChunkIndexEntry));
+
+   memcpy(trailer.magic, CONTAINER_TRAILER_MAGIC, sizeof(trailer.magic));
+   mWriter.Append(mFile, &trailer, sizeof(trailer));
+
+   mFile = -1;
+}
+
+// Whether the container, once closed, would stay within Limit bytes with
+// Record added.  It allows for Record starting a new stream and a new chunk.
+bool CContainerWriter::Fits(const TPacketRecord* Record, uint64_t Limit) const
+{
+   uint64_t bytes = mWriter.GetOffset(mFile) + mOpenBytes;
+
+   // what the footer needs now
+   bytes += mStreams.size() * sizeof(TContainerStream) +
+            (mIndex.size() + mOpenChunks) * sizeof(TChunkIndexEntry) +
+            sizeof(TContainerTrailer);
+
+   // and what Record could add to the file and the footer
+   bytes += sizeof(TChunkHeader) + 2 * sizeof(TContainerStream) +
+            sizeof(TChunkHeader) + sizeof(TChunkIndexEntry) + Record->DiskBytes();
+
+   return bytes <= Limit;
+}
+
+void CContainerWriter::Append(TPacketRecord* Record, double Now)
+{
+   uint64_t key = ((uint64_t)Record->from_ip.s_addr << 32) | Record->to_mcast_ip.s_addr;
+   auto     id = mStreamIds.find(key);
+
+   if (id == mStreamIds.end())
+   {
+      TStream      stream;
+      TChunkHeader chunk = {};
+
+      // new stream, define its ID in the file before any of its data
+      stream.stream.stream_id   = mStreams.size();
+      stream.stream.from_ip     = Record->from_ip.s_addr;
+      stream.stream.to_mcast_ip = Record->to_mcast_ip.s_addr;
+      stream.stream.reserved    = 0;
+      stream.chunk              = chunk;
+      stream.opened             = 0.0;
+
+      chunk.type      = CHUNK_STREAM;
+      chunk.stream_id = stream.stream.stream_id;
+      chunk.bytes     = sizeof(TContainerStream);
+
+      mWriter.Append(mFile, &chunk, sizeof(chunk));
+      mWriter.Append(mFile, &stream.stream, sizeof(stream.stream));
+
+      id = mStreamIds.emplace(key, stream.stream.stream_id).first;
+      mStreams.push_back(stream);
+   }
+
+   TStream& stream = mStreams[id->second];
+
+   if (stream.records.empty())
+   {
+      stream.chunk.type        = CHUNK_DATA;
+      stream.chunk.stream_id   = stream.stream.stream_id;
+      stream.chunk.num_records = 0;
+      stream.chunk.bytes       = 0;
+      stream.chunk.first_time  = Record->header.time;
+      stream.opened            = Now;
+      mOpenBytes += sizeof(TChunkHeader);
+      mOpenChunks++;
+   }
+
+   stream.records.push_back(Record);
+   stream.chunk.num_records++;
+   stream.chunk.bytes += Record->DiskBytes();
+   mOpenBytes += Record->DiskBytes();
+   stream.chunk.last_time = Record->header.time;
+
+   if (stream.chunk.bytes >= CHUNK_BYTES)
+      CloseChunk(stream);
+}
+
+// Closes the chunks that have been open longer than CHUNK_TIME so slow
+// streams still reach the disk (and release their arena records)
+void CContainerWriter::Service(double Now)
+{
+   for (size_t i = 0; i < mStreams.size(); i++)
+   {
+      if (!mStreams[i].records.empty() && Now - mStreams[i].opened >= CHUNK_TIME)
+         CloseChunk(mStreams[i]);
+   }
+}
+
+void CContainerWriter::CloseChunk(TStream& Stream)
+{
+   TChunkIndexEntry entry;
+
+   if (Stream.records.empty())
+      return;
+
+   entry.offset      = mWriter.GetOffset(mFile);
+   entry.stream_id   = Stream.chunk.stream_id;
+   entry.num_records = Stream.chunk.num_records;
+   entry.first_time  = Stream.chunk.first_time;
+   entry.last_time   = Stream.chunk.last_time;
+   mIndex.push_back(entry);
+
+   mWriter.Append(mFile, &Stream.chunk, sizeof(Stream.chunk));
+
+   for (size_t i = 0; i < Stream.records.size(); i++)
+      mWriter.Append(mFile, Stream.records[i]);
+
+   mOpenBytes -= sizeof(TChunkHeader) + Stream.chunk.bytes;
+   mOpenChunks--;
+
+   Stream.records.clear();
+}
+
+CContainerIndex::CContainerIndex()
+{
+   mRecovered = false;
+}
+
+CContainerIndex::~CContainerIndex()
+{
+}
+
+bool CContainerIndex::IsContainer(const char* Filename)
+{
+   TRecordFileHeader header;
+   FILE*             file = fopen(Filename, "rb");
+   bool              is_container = false;
+
+   if (file)
+   {
+      if (fread(&header, sizeof(header), 1, file) == 1)
+         is_container = (memcmp(header.magic, CONTAINER_MAGIC, sizeof(header.magic)) == 0);
+      fclose(file);
+   }
+
+   return is_container;
+}
+
+bool CContainerIndex::Load(const char* Filename, uint64_t Size)
+{
+   FILE* file = fopen(Filename, "rb");
+   off_t file_size;
+   bool  status;
+
+   mFilename = Filename;
+   mStreams.clear();
+   mChunks.clear();
+   mRecovered = false;
+
+   if (!file)
+   {
+      perror("CContainerIndex::Load(): fopen()");
+      return false;
+   }
+
+   if (fseeko(file, 0, SEEK_END) != 0 || (file_size = ftello(file)) < 0)
+   {
+      fclose(file);
+      return false;
+   }
+
+   if ((uint64_t)file_size > Size)
+      file_size = Size;
+
+   status = LoadFooter(file, file_size);
+
+   if (!status)
+   {
+      // no footer, the recorder did not get to close the file
+      mStreams.clear();
+      mChunks.clear();
+      mRecovered = true;
+      status = Scan(file, file_size);
+   }
+
+   fclose(file);
+
+   return status;
+}
+
+bool CContainerIndex::LoadFooter(FILE* File, off_t Size)
+{
+   TContainerTrailer trailer;
+
+   if (Size < (off_t)sizeof(trailer) ||
+       fseeko(File, Size - sizeof(trailer), SEEK_SET) != 0 ||
+       fread(&trailer, sizeof(trailer), 1, File) != 1 ||
+       memcmp(trailer.magic, CONTAINER_TRAILER_MAGIC, sizeof(trailer.magic)) != 0)
+   {
+      return false;
+   }
+
+   mStreams.resize(trailer.num_streams);
+   mChunks.resize(trailer.num_chunks);
+
+   if (fseeko(File, trailer.streams_offset, SEEK_SET) != 0 ||
+       fread(mStreams.data(), sizeof(TContainerStream), mStreams.size(), File) != mStreams.size())
+   {
+      return false;
+   }
+
+   if (fseeko(File, trailer.chunks_offset, SEEK_SET) != 0 ||
+       fread(mChunks.data(), sizeof(TChunkIndexEntry), mChunks.size(), File) != mChunks.size())
+   {
+      return false;
+   }
+
+   return true;
+}
+
+// Rebuilds the stream table and chunk index by walking the chunk headers
+// in the first Size bytes of the file
+bool CContainerIndex::Scan(FILE* File, off_t Size)
+{
+   TRecordFileHeader header;
+   TChunkHeader      chunk;
+   off_t             offset;
+
+   if (fseeko(File, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, File) != 1)
+      return false;
+
+   offset = header.header_size;
+
+   while (fseeko(File, offset, SEEK_SET) == 0 && fread(&chunk, sizeof(chunk), 1, File) == 1)
+   {
+      // stop at the footer, or at a chunk that was only partly written
+      if ((chunk.type != CHUNK_STREAM && chunk.type != CHUNK_DATA) ||
+          offset + (off_t)sizeof(chunk) + chunk.bytes > Size)
+      {
+         break;
+      }
+
+      if (chunk.type == CHUNK_STREAM)
+      {
+         TContainerStream stream;
+
+         if (fread(&stream, sizeof(stream), 1, File) != 1)
+            break;
+
+         mStreams.push_back(stream);
+      }
+      else
+      {
+         TChunkIndexEntry entry;
+
+         entry.offset      = offset;
+         entry.stream_id   = chunk.stream_id;
+         entry.num_records = chunk.num_records;
+         entry.first_time  = chunk.first_time;
+         entry.last_time   = chunk.last_time;
+
+         mChunks.push_back(entry);
+      }
+
+      offset += sizeof(chunk) + chunk.bytes;
+   }
+
+   return true;
+}
+
+std::vector<TChunkIndexEntry> CContainerIndex::GetStreamChunks(uint32_t StreamId) const
+{
+   std::vector<TChunkIndexEntry> chunks;
+
+   for (size_t i = 0; i < mChunks.size(); i++)
+   {
+      if (mChunks[i].stream_id == StreamId)
+         chunks.push_back(mChunks[i]);
+   }
+
+   return chunks;
+}
@@ -0,0 +1,127 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Container
+//  Class:      C++ Header
+//  Filename:   Container.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CContainerWriter
+//! \brief Writes a session container (.urec)
+//!
+//! Records are gathered per stream into chunks that are closed when they
+//! reach CHUNK_BYTES or have been open for CHUNK_TIME.  Closed chunks are
+//! appended to the one container file through the CRecordWriter, and the
+//! stream table and chunk index are written as a footer on Close.
+//!
+//! Open can also start a container in a file the CRecordWriter already has
+//! open, such as a reused segment, and Fits tells whether one more record
+//! would keep the closed container within a size.
+//!
+//! \class CContainerIndex
+//! \brief Reads the stream table and chunk index of a session container
+//!
+//! Uses the footer when there is one, otherwise walks the chunks from the
+//! start of the file to rebuild it.  Given a size, it looks no further into
+//! the file than that, for files that hold stale data past their end.
+//!
+//! See RecordFile.h for the layout.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "RecordFile.h"
+#include "RecordWriter.h"
+
+class CContainerWriter
+{
+public:
+   static constexpr uint32_t CHUNK_BYTES = 64 * 1024;
+   static constexpr double   CHUNK_TIME  = 0.1;
+
+   explicit CContainerWriter(CRecordWriter& Writer);
+   ~CContainerWriter();
+
+   bool Open(const char* Filename);
+   void Open(int File);
+   void Close();
+
+   void Append(TPacketRecord* Record, double Now);
+   void Service(double Now);
+
+   bool Fits(const TPacketRecord* Record, uint64_t Limit) const;
+
+   int GetNumStreams() const { return (int)mStreams.size(); }
+   int GetNumChunks() const { return (int)mIndex.size(); }
+
+   const std::vector<TChunkIndexEntry>& GetChunks() const { return mIndex; }
+
+private:
+   struct TStream
+   {
+      TContainerStream            stream;
+      TChunkHeader                chunk;
+      std::vector<TPacketRecord*> records;
+      double                      opened;
+   };
+
+   void CloseChunk(TStream& Stream);
+
+   CRecordWriter&                         mWriter;
+   int                                    mFile;
+   std::unordered_map<uint64_t, uint32_t> mStreamIds;
+   std::vector<TStream>                   mStreams;
+   std::vector<TChunkIndexEntry>          mIndex;
+   uint64_t                               mOpenBytes;  // chunk headers and records not yet appended
+   uint32_t                               mOpenChunks;
+};
+
+class CContainerIndex
+{
+public:
+   CContainerIndex();
+   ~CContainerIndex();
+
+   static bool IsContainer(const char* Filename);
+
+   bool Load(const char* Filename, uint64_t Size = UINT64_MAX);
+
+   const std::string&                   GetFilename() const { return mFilename; }
+   const std::vector<TContainerStream>& GetStreams() const { return mStreams; }
+   const std::vector<TChunkIndexEntry>& GetChunks() const { return mChunks; }
+   bool                                 WasRecovered() const { return mRecovered; }
+
+   std::vector<TChunkIndexEntry> GetStreamChunks(uint32_t StreamId) const;
+
+private:
+   bool LoadFooter(FILE* File, off_t Size);
+   bool Scan(FILE* File, off_t Size);
+
+   std::string                   mFilename;
+   std::vector<TContainerStream> mStreams;
+   std::vector<TChunkIndexEntry> mChunks;
+   bool                          mRecovered;
+};
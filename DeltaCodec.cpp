@@ -0,0 +1,210 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Delta Codec
+//  Class:      C++ Source
+//  Filename:   DeltaCodec.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "DeltaCodec.h"
+
+// Returns the first position from Pos where A and B differ, Bytes if none
+static inline size_t find_difference(const uint8_t* A, const uint8_t* B, size_t Pos, size_t Bytes)
+{
+#if defined(__SSE2__)
+   for (; Pos + 16 <= Bytes; Pos += 16)
+   {
+      __m128i  a = _mm_loadu_si128((const __m128i*)(A + Pos));
+      __m128i  b = _mm_loadu_si128((const __m128i*)(B + Pos));
+      uint32_t differ = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffff;
+
+      if (differ)
+         return Pos + __builtin_ctz(differ);
+   }
+#endif
+
+   while (Pos < Bytes && A[Pos] == B[Pos])
+      Pos++;
+
+   return Pos;
+}
+
+// Returns the end of the run of changes starting at Start, which stops at the
+// first MIN_GAP unchanged bytes
+static inline size_t find_run_end(const uint8_t* A, const uint8_t* B, size_t Start, size_t Bytes)
+{
+   size_t last = Start;
+
+   for (size_t pos = Start + 1; pos < Bytes && pos - last <= CDeltaCodec::MIN_GAP; pos++)
+   {
+      if (A[pos] != B[pos])
+         last = pos;
+   }
+
+   return last + 1;
+}
+
+// Out = A ^ B over Bytes
+static inline void xor_bytes(uint8_t* Out, const uint8_t* A, const uint8_t* B, size_t Bytes)
+{
+   size_t pos = 0;
+
+#if defined(__SSE2__)
+   for (; pos + 16 <= Bytes; pos += 16)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i*)(A + pos));
+      __m128i b = _mm_loadu_si128((const __m128i*)(B + pos));
+
+      _mm_storeu_si128((__m128i*)(Out + pos), _mm_xor_si128(a, b));
+   }
+#endif
+
+   for (; pos < Bytes; pos++)
+      Out[pos] = A[pos] ^ B[pos];
+}
+
+static inline bool put_varint(uint8_t*& Out, const uint8_t* End, size_t Value)
+{
+   do
+   {
+      if (Out == End)
+         return false;
+
+      *Out++ = (Value & 0x7f) | (Value >= 0x80 ? 0x80 : 0);
+      Value >>= 7;
+   } while (Value);
+
+   return true;
+}
+
+static inline bool get_varint(const uint8_t*& In, const uint8_t* End, size_t& Value)
+{
+   Value = 0;
+
+   for (int shift = 0; In < End && shift < 64; shift += 7)
+   {
+      uint8_t byte = *In++;
+
+      Value |= (size_t)(byte & 0x7f) << shift;
+
+      if (!(byte & 0x80))
+         return true;
+   }
+
+   return false;
+}
+
+bool CDeltaCodec::Encode(const char* Previous, const char* Payload, size_t Bytes, char* Encoded, size_t MaxEncoded, size_t& EncodedBytes)
+{
+   const uint8_t* a = (const uint8_t*)Previous;
+   const uint8_t* b = (const uint8_t*)Payload;
+   uint8_t*       out = (uint8_t*)Encoded;
+   const uint8_t* end = out + MaxEncoded;
+   size_t         skip_from = 0; // end of the last run
+   size_t         start;
+
+   while ((start = find_difference(a, b, skip_from, Bytes)) < Bytes)
+   {
+      size_t run_end = find_run_end(a, b, start, Bytes);
+
+      if (!put_varint(out, end, start - skip_from) || !put_varint(out, end, run_end - start) ||
+          (size_t)(end - out) < run_end - start)
+         return false;
+
+      xor_bytes(out, a + start, b + start, run_end - start);
+      out += run_end - start;
+      skip_from = run_end;
+   }
+
+   EncodedBytes = out - (uint8_t*)Encoded;
+
+   return true;
+}
+
+bool CDeltaCodec::Decode(const char* Previous, const char* Encoded, size_t EncodedBytes, char* Payload, size_t Bytes)
+{
+   const uint8_t* in = (const uint8_t*)Encoded;
+   const uint8_t* end = in + EncodedBytes;
+   uint8_t*       out = (uint8_t*)Payload;
+   size_t         pos = 0;
+
+   memcpy(Payload, Previous, Bytes);
+
+   while (in < end)
+   {
+      size_t skip;
+      size_t count;
+
+      if (!get_varint(in, end, skip) || !get_varint(in, end, count) ||
+          skip > Bytes - pos || count > Bytes - pos - skip || count > (size_t)(end - in))
+         return false;
+
+      pos += skip;
+      xor_bytes(out + pos, out + pos, in, count);
+      pos += count;
+      in += count;
+   }
+
+   return true;
+}
+
+CDeltaEncoder::CDeltaEncoder()
+{
+   mHasPrevious = false;
+   mSinceKeyframe = 0;
+   mDeltas = 0;
+   mBytesSaved = 0;
+}
+
+CDeltaEncoder::~CDeltaEncoder()
+{
+}
+
+bool CDeltaEncoder::Encode(const char* Payload, uint64_t Bytes, bool Keyframe, char* Encoded, uint64_t& EncodedBytes)
+{
+   size_t encoded = 0;
+   bool   delta = !Keyframe && mHasPrevious && mPrevious.size() == Bytes && mSinceKeyframe < KEYFRAME_INTERVAL &&
+                  CDeltaCodec::Encode(mPrevious.data(), Payload, Bytes, Encoded, Bytes > 0 ? Bytes - 1 : 0, encoded);
+
+   // every payload is the base of the next, whichever way it is written
+   mPrevious.assign(Payload, Payload + Bytes);
+   mHasPrevious = true;
+
+   if (!delta)
+   {
+      mSinceKeyframe = 0;
+      return false;
+   }
+
+   mSinceKeyframe++;
+   mDeltas++;
+   mBytesSaved += Bytes - encoded;
+   EncodedBytes = encoded;
+
+   return true;
+}
@@ -0,0 +1,89 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Delta Codec
+//  Class:      C++ Header
+//  Filename:   DeltaCodec.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CDeltaCodec
+//! \brief Run-length coded XOR of a payload against the one before it
+//!
+//! An encoding is a sequence of runs, each a varint count of unchanged bytes
+//! to skip, a varint count of changed bytes and that many bytes of the XOR of
+//! the two payloads.  Bytes after the last run are unchanged, so a payload
+//! identical to the one before it encodes to nothing.  Changed bytes closer
+//! together than MIN_GAP share a run, since a new run costs two counts.
+//!
+//! Both payloads must be the same length.  Unchanged spans are skipped and
+//! runs are XORed 16 bytes at a time with SSE2 where the target has it.
+//!
+//! \class CDeltaEncoder
+//! \brief Delta encodes the records of one recorded stream
+//!
+//! Keeps a copy of the stream's previous payload and encodes each new one
+//! against it, unless the record has to be a keyframe: the first record, a
+//! change of length, every KEYFRAME_INTERVAL records, or whenever the caller
+//! asks (where the time index will point, so seeking always lands on a
+//! record that decodes on its own).
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class CDeltaCodec
+{
+public:
+   static constexpr size_t MIN_GAP = 3;
+
+   // Encodes Payload against Previous, false if the encoding would take
+   // more than MaxEncoded bytes
+   static bool Encode(const char* Previous, const char* Payload, size_t Bytes, char* Encoded, size_t MaxEncoded, size_t& EncodedBytes);
+
+   // Rebuilds Payload from Previous, fails on a corrupt encoding
+   static bool Decode(const char* Previous, const char* Encoded, size_t EncodedBytes, char* Payload, size_t Bytes);
+};
+
+class CDeltaEncoder
+{
+public:
+   static constexpr uint32_t KEYFRAME_INTERVAL = 256;
+
+   CDeltaEncoder();
+   ~CDeltaEncoder();
+
+   // Encodes Payload against the previous payload into Encoded, which has
+   // room for Bytes.  Returns false if the record is written whole.
+   bool Encode(const char* Payload, uint64_t Bytes, bool Keyframe, char* Encoded, uint64_t& EncodedBytes);
+
+   uint64_t GetDeltas() const { return mDeltas; }
+   uint64_t GetBytesSaved() const { return mBytesSaved; }
+
+private:
+   std::vector<char> mPrevious;
+   bool              mHasPrevious;
+   uint32_t          mSinceKeyframe; // records since the last keyframe
+   uint64_t          mDeltas;
+   uint64_t          mBytesSaved;
+};
@@ -0,0 +1,263 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      IoUring CSU
+//  Class:      C++ Source
+//  Filename:   IoUring.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "IoUring.h"
+
+CIoUring::CIoUring()
+{
+   mRingFd = -1;
+   mPending = 0;
+   mSqRing = MAP_FAILED;
+   mCqRing = MAP_FAILED;
+   mSqes = (struct io_uring_sqe*)MAP_FAILED;
+}
+
+CIoUring::~CIoUring()
+{
+   Close();
+}
+
+bool CIoUring::Open(unsigned int Entries)
+{
+   struct io_uring_params params;
+
+   if (mRingFd >= 0)
+      return true;
+
+   memset(&params, 0, sizeof(params));
+
+   mRingFd = syscall(__NR_io_uring_setup, Entries, &params);
+
+   if (mRingFd < 0)
+      return false;
+
+   mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+   mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+   // newer kernels map both rings with one mmap
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if (mCqRingSize > mSqRingSize)
+         mSqRingSize = mCqRingSize;
+      mCqRingSize = mSqRingSize;
+   }
+
+   mSqRing = mmap(0, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+
+   if (mSqRing == MAP_FAILED)
+   {
+      perror("CIoUring::Open(): mmap() sq ring");
+      Close();
+      return false;
+   }
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      mCqRing = mSqRing;
+   }
+   else
+   {
+      mCqRing = mmap(0, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+
+      if (mCqRing == MAP_FAILED)
+      {
+         perror("CIoUring::Open(): mmap() cq ring");
+         Close();
+         return false;
+      }
+   }
+
+   mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+   mSqes = (struct io_uring_sqe*)mmap(0, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+
+   if (mSqes == MAP_FAILED)
+   {
+      perror("CIoUring::Open(): mmap() sqes");
+      Close();
+      return false;
+   }
+
+   char* sq = (char*)mSqRing;
+   char* cq = (char*)mCqRing;
+
+   mSqHead    = (unsigned int*)(sq + params.sq_off.head);
+   mSqTail    = (unsigned int*)(sq + params.sq_off.tail);
+   mSqMask    = (unsigned int*)(sq + params.sq_off.ring_mask);
+   mSqEntries = (unsigned int*)(sq + params.sq_off.ring_entries);
+   mSqArray   = (unsigned int*)(sq + params.sq_off.array);
+
+   mCqHead = (unsigned int*)(cq + params.cq_off.head);
+   mCqTail = (unsigned int*)(cq + params.cq_off.tail);
+   mCqMask = (unsigned int*)(cq + params.cq_off.ring_mask);
+   mCqes   = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+   mPending = 0;
+
+   return true;
+}
+
+void CIoUring::Close()
+{
+   if (mSqes != MAP_FAILED)
+      munmap(mSqes, mSqesSize);
+   if (mCqRing != MAP_FAILED && mCqRing != mSqRing)
+      munmap(mCqRing, mCqRingSize);
+   if (mSqRing != MAP_FAILED)
+      munmap(mSqRing, mSqRingSize);
+   if (mRingFd >= 0)
+      close(mRingFd);
+
+   mRingFd = -1;
+   mSqRing = MAP_FAILED;
+   mCqRing = MAP_FAILED;
+   mSqes = (struct io_uring_sqe*)MAP_FAILED;
+}
+
+unsigned int CIoUring::SpaceLeft() const
+{
+   unsigned int head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+
+   return *mSqEntries - (*mSqTail - head);
+}
+
+// Returns the next free submission entry, cleared, or nullptr if the
+// submission queue is full.  The entry is not visible to the kernel until
+// Publish is called.
+struct io_uring_sqe* CIoUring::GetSqe()
+{
+   if (mRingFd < 0 || SpaceLeft() == 0)
+      return nullptr;
+
+   unsigned int         index = *mSqTail & *mSqMask;
+   struct io_uring_sqe* sqe = &mSqes[index];
+
+   memset(sqe, 0, sizeof(*sqe));
+   mSqArray[index] = index;
+
+   return sqe;
+}
+
+void CIoUring::Publish()
+{
+   __atomic_store_n(mSqTail, *mSqTail + 1, __ATOMIC_RELEASE);
+   mPending++;
+}
+
+bool CIoUring::PrepWritev(int Fd, const struct iovec* Iov, int NumIov, uint64_t Offset, uint64_t UserData)
+{
+   struct io_uring_sqe* sqe = GetSqe();
+
+   if (!sqe)
+      return false;
+
+   sqe->opcode    = IORING_OP_WRITEV;
+   sqe->fd        = Fd;
+   sqe->addr      = (uint64_t)(uintptr_t)Iov;
+   sqe->len       = NumIov;
+   sqe->off       = Offset;
+   sqe->user_data = UserData;
+
+   Publish();
+
+   return true;
+}
+
+// Flushes the data of Fd that has been written so far, as fdatasync would
+bool CIoUring::PrepFdatasync(int Fd, uint64_t UserData)
+{
+   struct io_uring_sqe* sqe = GetSqe();
+
+   if (!sqe)
+      return false;
+
+   sqe->opcode      = IORING_OP_FSYNC;
+   sqe->fd          = Fd;
+   sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+   sqe->user_data   = UserData;
+
+   Publish();
+
+   return true;
+}
+
+// Hands all prepared entries to the kernel and optionally waits for WaitFor
+// completions.  Returns the number of entries submitted or -1.
+int CIoUring::Submit(unsigned int WaitFor)
+{
+   unsigned int flags = WaitFor ? IORING_ENTER_GETEVENTS : 0;
+   int          status;
+
+   if (mRingFd < 0)
+      return -1;
+
+   if (mPending == 0 && WaitFor == 0)
+      return 0;
+
+   do
+   {
+      status = syscall(__NR_io_uring_enter, mRingFd, mPending, WaitFor, flags, NULL, 0);
+   } while (status < 0 && errno == EINTR);
+
+   if (status < 0)
+   {
+      perror("CIoUring::Submit(): io_uring_enter()");
+      return -1;
+   }
+
+   mPending -= status;
+
+   return status;
+}
+
+bool CIoUring::PeekCompletion(uint64_t& UserData, int& Result)
+{
+   if (mRingFd < 0)
+      return false;
+
+   unsigned int head = *mCqHead;
+   unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+
+   if (head == tail)
+      return false;
+
+   struct io_uring_cqe* cqe = &mCqes[head & *mCqMask];
+
+   UserData = cqe->user_data;
+   Result   = cqe->res;
+
+   __atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+
+   return true;
+}
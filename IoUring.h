@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      IoUring CSU
+//  Class:      C++ Header
+//  Filename:   IoUring.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CIoUring
+//! \brief Minimal io_uring wrapper
+//!
+//! Talks to the kernel with the raw io_uring_setup/io_uring_enter system
+//! calls so there is no dependency on liburing.  Only what the recorder
+//! needs is here: queue writev and fsync requests, submit them, and reap
+//! completions.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+class CIoUring
+{
+public:
+   CIoUring();
+   ~CIoUring();
+
+   bool Open(unsigned int Entries);
+   void Close();
+
+   bool IsOpen() const { return mRingFd >= 0; }
+
+   bool PrepWritev(int Fd, const struct iovec* Iov, int NumIov, uint64_t Offset, uint64_t UserData);
+   bool PrepFdatasync(int Fd, uint64_t UserData);
+   int  Submit(unsigned int WaitFor);
+   bool PeekCompletion(uint64_t& UserData, int& Result);
+
+   unsigned int SpaceLeft() const;
+
+private:
+   int          mRingFd;
+   unsigned int mPending;
+
+   // submission queue
+   void*                mSqRing;
+   size_t               mSqRingSize;
+   unsigned int*        mSqHead;
+   unsigned int*        mSqTail;
+   unsigned int*        mSqMask;
+   unsigned int*        mSqEntries;
+   unsigned int*        mSqArray;
+   struct io_uring_sqe* mSqes;
+   size_t               mSqesSize;
+
+   // completion queue
+   void*                mCqRing;
+   size_t               mCqRingSize;
+   unsigned int*        mCqHead;
+   unsigned int*        mCqTail;
+   unsigned int*        mCqMask;
+   struct io_uring_cqe* mCqes;
+
+   struct io_uring_sqe* GetSqe();
+   void                 Publish();
+};
@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Logger
+//  Class:      C++ Source
+//  Filename:   Logger.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SimTimer.h"
+#include "Logger.h"
+
+CLogger::CLogger()
+{
+   mQueue = new TLogMessage[QUEUE_SIZE];
+
+   // a slot is free for the producer at position p when its sequence is p
+   for (uint32_t i = 0; i < QUEUE_SIZE; i++)
+      mQueue[i].sequence.store(i, std::memory_order_relaxed);
+
+   mEnqueue = 0;
+   mDequeue = 0;
+   mDropped = 0;
+   mRunning = false;
+   mLevel = LOG_INFO;
+}
+
+CLogger::~CLogger()
+{
+   Stop();
+   delete[] mQueue;
+}
+
+bool CLogger::ParseLevel(const char* Name, eLogLevel& Level)
+{
+   for (int i = LOG_ERROR; i <= LOG_PACKET; i++)
+   {
+      if (strcmp(Name, GetLevelName((eLogLevel)i)) == 0)
+      {
+         Level = (eLogLevel)i;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+const char* CLogger::GetLevelName(eLogLevel Level)
+{
+   switch (Level)
+   {
+      case LOG_ERROR:   return "error";
+      case LOG_WARNING: return "warning";
+      case LOG_INFO:    return "info";
+      case LOG_PACKET:  return "packet";
+   }
+
+   return "unknown";
+}
+
+void CLogger::Start()
+{
+   if (mRunning)
+      return;
+
+   mRunning = true;
+   mThread = std::thread(&CLogger::Run, this);
+}
+
+// Stops the logger thread once everything queued is written
+void CLogger::Stop()
+{
+   if (!mRunning)
+      return;
+
+   mRunning = false;
+   mThread.join();
+
+   if (GetDropped())
+      printf("Logger: %lu messages dropped\n", GetDropped());
+
+   fflush(stdout);
+}
+
+void CLogger::Log(eLogLevel Level, const char* Format, ...)
+{
+   uint64_t     position = mEnqueue.load(std::memory_order_relaxed);
+   TLogMessage* message;
+   va_list      args;
+
+   if (!IsEnabled(Level))
+      return;
+
+   // claim a slot, several threads may be logging at once
+   while (true)
+   {
+      message = &mQueue[position & (QUEUE_SIZE - 1)];
+
+      int64_t diff = (int64_t)message->sequence.load(std::memory_order_acquire) - (int64_t)position;
+
+      if (diff == 0)
+      {
+         if (mEnqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            break;
+      }
+      else if (diff < 0)
+      {
+         // full, the logger thread is behind
+         mDropped.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+      else
+      {
+         position = mEnqueue.load(std::memory_order_relaxed);
+      }
+   }
+
+   message->time = CSimTimer::GetRealTime();
+   message->level = Level;
+
+   va_start(args, Format);
+   vsnprintf(message->text, sizeof(message->text), Format, args);
+   va_end(args);
+
+   // hand the slot to the logger thread
+   message->sequence.store(position + 1, std::memory_order_release);
+}
+
+// Writes out the queued messages in order, returns false if there were none
+bool CLogger::Drain()
+{
+   bool wrote = false;
+
+   while (true)
+   {
+      TLogMessage& message = mQueue[mDequeue & (QUEUE_SIZE - 1)];
+
+      if (message.sequence.load(std::memory_order_acquire) != mDequeue + 1)
+         break;
+
+      struct tm tm;
+      time_t    secs = (time_t)message.time;
+      int       usecs = (int)((message.time - secs) * 1000000.0);
+
+      localtime_r(&secs, &tm);
+
+      // same stamp as CSimTimer::GetCurrentTimeStr
+      fprintf(stdout, "%02d:%02d:%02d.%06d: %s%s\n", tm.tm_hour, tm.tm_min, tm.tm_sec, usecs,
+         (message.level == LOG_ERROR) ? "Error: " : (message.level == LOG_WARNING) ? "Warning: " : "", message.text);
+
+      // free the slot for the producers' next lap
+      message.sequence.store(mDequeue + QUEUE_SIZE, std::memory_order_release);
+      mDequeue++;
+      wrote = true;
+   }
+
+   return wrote;
+}
+
+void CLogger::Run()
+{
+   while (mRunning)
+   {
+      Drain();
+
+      // also pushes out anything printed directly to stdout
+      fflush(stdout);
+
+      usleep(FLUSH_MS * 1000);
+   }
+
+   Drain();
+   fflush(stdout);
+}
@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Logger
+//  Class:      C++ Header
+//  Filename:   Logger.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CLogger
+//! \brief Log queue drained to stdout by a background thread
+//!
+//! Log formats the message into a slot of a bounded lock-free queue (safe to
+//! call from any thread) and returns; the logger thread adds the time stamp
+//! and writes everything queued with one buffered write every FLUSH_MS.  When
+//! the queue is full the message is dropped and counted rather than blocking
+//! the caller.
+//!
+//! Messages above the selected level are discarded before being formatted,
+//! so per packet LOG_PACKET lines cost only a compare unless enabled.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+enum eLogLevel
+{
+   LOG_ERROR,
+   LOG_WARNING,
+   LOG_INFO,
+   LOG_PACKET
+};
+
+class CLogger
+{
+public:
+   static constexpr uint32_t QUEUE_SIZE  = 8192; // power of 2
+   static constexpr int      MAX_MESSAGE = 240;
+   static constexpr int      FLUSH_MS    = 10;
+
+   CLogger();
+   ~CLogger();
+
+   static bool        ParseLevel(const char* Name, eLogLevel& Level);
+   static const char* GetLevelName(eLogLevel Level);
+
+   void Start();
+   void Stop();
+
+   void      SetLevel(eLogLevel Level) { mLevel = Level; }
+   eLogLevel GetLevel() const { return mLevel; }
+   bool      IsEnabled(eLogLevel Level) const { return Level <= mLevel; }
+
+   void Log(eLogLevel Level, const char* Format, ...) __attribute__((format(printf, 3, 4)));
+
+   uint64_t GetDropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+   struct TLogMessage
+   {
+      std::atomic<uint64_t> sequence;
+      double                time;  // CLOCK_REALTIME
+      eLogLevel             level;
+      char                  text[MAX_MESSAGE];
+   };
+
+   void Run();
+   bool Drain();
+
+   TLogMessage*          mQueue;
+   alignas(64) std::atomic<uint64_t> mEnqueue;
+   alignas(64) uint64_t  mDequeue;
+   std::atomic<uint64_t> mDropped;
+   std::atomic<bool>     mRunning;
+   std::thread           mThread;
+   eLogLevel             mLevel;
+};
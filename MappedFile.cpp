@@ -0,0 +1,135 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Mapped File
+//  Class:      C++ Source
+//  Filename:   MappedFile.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MappedFile.h"
+
+CMappedFile::CMappedFile()
+{
+   mOpen = false;
+   mData = nullptr;
+   mSize = 0;
+   mPrefetched = 0;
+}
+
+CMappedFile::~CMappedFile()
+{
+   Close();
+}
+
+bool CMappedFile::Open(const char* Filename)
+{
+   struct stat info;
+   int         fd;
+
+   Close();
+
+   fd = open(Filename, O_RDONLY);
+
+   if (fd < 0)
+   {
+      printf("Error: could not open %s\n", Filename);
+      return false;
+   }
+
+   if (fstat(fd, &info) != 0)
+   {
+      close(fd);
+      return false;
+   }
+
+   mSize = info.st_size;
+
+   // an empty file has nothing to map
+   if (mSize > 0)
+   {
+      void* data = mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+
+      if (data == MAP_FAILED)
+      {
+         perror("CMappedFile::Open(): mmap()");
+         close(fd);
+         mSize = 0;
+         return false;
+      }
+
+      mData = (const char*)data;
+      madvise(data, mSize, MADV_SEQUENTIAL);
+   }
+
+   // the mapping stays valid after the descriptor is closed
+   close(fd);
+
+   mOpen = true;
+   mPrefetched = 0;
+   Prefetch(0);
+
+   return true;
+}
+
+void CMappedFile::Close()
+{
+   if (mData)
+      munmap((void*)mData, mSize);
+
+   mOpen = false;
+   mData = nullptr;
+   mSize = 0;
+   mPrefetched = 0;
+}
+
+// Called as the reader moves through the file, starts read ahead of the next
+// READ_AHEAD bytes once the reader is half way through the last range
+void CMappedFile::Prefetch(uint64_t Offset)
+{
+   static const uint64_t page_mask = ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+
+   uint64_t start;
+   uint64_t end;
+
+   if (!mData || (Offset + READ_AHEAD / 2 < mPrefetched && Offset + READ_AHEAD >= mPrefetched))
+      return;
+
+   // a seek backwards or past the range starts over from Offset
+   start = (Offset < mPrefetched && Offset + READ_AHEAD >= mPrefetched) ? mPrefetched : Offset;
+   start &= page_mask;
+   end = Offset + READ_AHEAD;
+
+   if (end > mSize)
+      end = mSize;
+
+   if (start < end)
+      madvise((void*)(mData + start), end - start, MADV_WILLNEED);
+
+   mPrefetched = end;
+}
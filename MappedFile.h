@@ -0,0 +1,65 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Mapped File
+//  Class:      C++ Header
+//  Filename:   MappedFile.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CMappedFile
+//! \brief Read only memory mapping of a recording
+//!
+//! Playback reads records in place out of the mapping, so payloads go to the
+//! socket without being copied.  The whole file is marked MADV_SEQUENTIAL and
+//! Prefetch asks the kernel to start reading the next READ_AHEAD bytes before
+//! the reader gets there.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+
+class CMappedFile
+{
+public:
+   static constexpr uint64_t READ_AHEAD = 4 * 1024 * 1024;
+
+   CMappedFile();
+   ~CMappedFile();
+
+   bool Open(const char* Filename);
+   void Close();
+
+   void Prefetch(uint64_t Offset);
+
+   bool        IsOpen() const { return mOpen; }
+   const char* GetData() const { return mData; }
+   uint64_t    GetSize() const { return mSize; }
+
+private:
+   CMappedFile(const CMappedFile&) = delete;
+   CMappedFile& operator=(const CMappedFile&) = delete;
+
+   bool        mOpen;
+   const char* mData;
+   uint64_t    mSize;
+   uint64_t    mPrefetched; // end of the range already passed to MADV_WILLNEED
+};
@@ -0,0 +1,398 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Metrics
+//  Class:      C++ Source
+//  Filename:   Metrics.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <map>
+#include <algorithm>
+#include "SimTimer.h"
+#include "Metrics.h"
+
+// Appends one printf formatted line (or part of one) to Text
+void AppendMetric(std::string& Text, const char* Format, ...)
+{
+   char    line[256];
+   va_list args;
+
+   va_start(args, Format);
+   vsnprintf(line, sizeof(line), Format, args);
+   va_end(args);
+
+   Text += line;
+}
+
+CLatencyHistogram::CLatencyHistogram()
+{
+   for (int i = 0; i < NUM_BINS; i++)
+      mBins[i] = 0;
+
+   mMax = 0;
+}
+
+TLatencySnapshot::TLatencySnapshot()
+{
+   memset(bins, 0, sizeof(bins));
+   count = 0;
+   max = 0;
+}
+
+void TLatencySnapshot::Add(const CLatencyHistogram& Histogram)
+{
+   for (int i = 0; i < CLatencyHistogram::NUM_BINS; i++)
+   {
+      uint64_t n = Histogram.mBins[i].load(std::memory_order_relaxed);
+
+      bins[i] += n;
+      count += n;
+   }
+
+   if (Histogram.mMax.load(std::memory_order_relaxed) > max)
+      max = Histogram.mMax.load(std::memory_order_relaxed);
+}
+
+// Upper bound in ns of the bin holding the given fraction of the samples,
+// never more than the largest sample
+uint64_t TLatencySnapshot::Percentile(double Fraction) const
+{
+   uint64_t target = (uint64_t)(Fraction * count);
+   uint64_t seen = 0;
+
+   for (int i = 0; i < CLatencyHistogram::NUM_BINS - 1; i++)
+   {
+      seen += bins[i];
+
+      if (seen > target)
+         return std::min(2ull << i, (unsigned long long)max);
+   }
+
+   return max;
+}
+
+void TLatencySnapshot::Format(std::string& Text, const char* Name) const
+{
+   AppendMetric(Text, "%s_count %lu\n", Name, count);
+
+   if (count == 0)
+      return;
+
+   AppendMetric(Text, "%s_p50_us %.1f\n", Name, Percentile(0.5) / 1000.0);
+   AppendMetric(Text, "%s_p99_us %.1f\n", Name, Percentile(0.99) / 1000.0);
+   AppendMetric(Text, "%s_p999_us %.1f\n", Name, Percentile(0.999) / 1000.0);
+   AppendMetric(Text, "%s_max_us %.1f\n", Name, max / 1000.0);
+}
+
+CStreamMetricsTable::CStreamMetricsTable(uint32_t Capacity)
+{
+   mStreams = new TStreamMetrics[Capacity];
+   mCapacity = Capacity;
+   mCount = 0;
+   mPrevTime = CSimTimer::GetCurrentTime();
+}
+
+CStreamMetricsTable::~CStreamMetricsTable()
+{
+   delete[] mStreams;
+}
+
+// Adds a stream, only ever called from one thread.  Returns NULL when the
+// table is full.
+TStreamMetrics* CStreamMetricsTable::Add(struct in_addr FromIp, struct in_addr ToMcastIp)
+{
+   uint32_t        count = mCount.load(std::memory_order_relaxed);
+   TStreamMetrics* stream;
+
+   if (count >= mCapacity)
+      return nullptr;
+
+   stream = &mStreams[count];
+   stream->from_ip      = FromIp;
+   stream->to_mcast_ip  = ToMcastIp;
+   stream->packets      = 0;
+   stream->bytes        = 0;
+   stream->prev_packets = 0;
+   stream->prev_bytes   = 0;
+
+   // publish the new entry to the server thread
+   mCount.store(count + 1, std::memory_order_release);
+
+   return stream;
+}
+
+uint64_t CStreamMetricsTable::GetPackets() const
+{
+   uint32_t count = GetCount();
+   uint64_t total = 0;
+
+   for (uint32_t i = 0; i < count; i++)
+      total += mStreams[i].packets.load(std::memory_order_relaxed);
+
+   return total;
+}
+
+uint64_t CStreamMetricsTable::GetBytes() const
+{
+   uint32_t count = GetCount();
+   uint64_t total = 0;
+
+   for (uint32_t i = 0; i < count; i++)
+      total += mStreams[i].bytes.load(std::memory_order_relaxed);
+
+   return total;
+}
+
+// Adds a line per stream, source and group with totals and the rates since
+// the previous call
+void CStreamMetricsTable::Format(std::string& Text, double Now)
+{
+   struct TTotals
+   {
+      uint64_t packets = 0;
+      uint64_t bytes = 0;
+      uint64_t new_packets = 0;
+      uint64_t new_bytes = 0;
+   };
+
+   uint32_t                     count = GetCount();
+   double                       elapsed = Now - mPrevTime;
+   std::map<uint32_t, TTotals>  sources;
+   std::map<uint32_t, TTotals>  groups;
+   char                         from_ip[INET_ADDRSTRLEN];
+   char                         to_mcast_ip[INET_ADDRSTRLEN];
+
+   if (elapsed <= 0.0)
+      elapsed = 1.0;
+
+   auto add_line = [&](const char* Kind, const char* Address, const TTotals& Totals)
+   {
+      AppendMetric(Text, "%s %s packets %lu bytes %lu pps %.1f mbps %.3f\n", Kind, Address, Totals.packets, Totals.bytes,
+         Totals.new_packets / elapsed, Totals.new_bytes * 8.0 / elapsed / 1e6);
+   };
+
+   AppendMetric(Text, "streams %u\n", count);
+
+   for (uint32_t i = 0; i < count; i++)
+   {
+      TStreamMetrics& stream = mStreams[i];
+      TTotals         totals;
+
+      totals.packets = stream.packets.load(std::memory_order_relaxed);
+      totals.bytes = stream.bytes.load(std::memory_order_relaxed);
+      totals.new_packets = totals.packets - stream.prev_packets;
+      totals.new_bytes = totals.bytes - stream.prev_bytes;
+
+      stream.prev_packets = totals.packets;
+      stream.prev_bytes = totals.bytes;
+
+      TTotals& source = sources[ntohl(stream.from_ip.s_addr)];
+      TTotals& group = groups[ntohl(stream.to_mcast_ip.s_addr)];
+
+      for (TTotals* sum : { &source, &group })
+      {
+         sum->packets += totals.packets;
+         sum->bytes += totals.bytes;
+         sum->new_packets += totals.new_packets;
+         sum->new_bytes += totals.new_bytes;
+      }
+
+      inet_ntop(AF_INET, &stream.from_ip, from_ip, sizeof(from_ip));
+      inet_ntop(AF_INET, &stream.to_mcast_ip, to_mcast_ip, sizeof(to_mcast_ip));
+
+      std::string address = std::string(from_ip) + " " + to_mcast_ip;
+
+      add_line("stream", address.c_str(), totals);
+   }
+
+   for (const auto& source : sources)
+   {
+      struct in_addr address = { htonl(source.first) };
+
+      inet_ntop(AF_INET, &address, from_ip, sizeof(from_ip));
+      add_line("source", from_ip, source.second);
+   }
+
+   for (const auto& group : groups)
+   {
+      struct in_addr address = { htonl(group.first) };
+
+      inet_ntop(AF_INET, &address, to_mcast_ip, sizeof(to_mcast_ip));
+      add_line("group", to_mcast_ip, group.second);
+   }
+
+   mPrevTime = Now;
+}
+
+CMetricsServer::CMetricsServer()
+{
+   mListen = -1;
+   mRunning = false;
+}
+
+CMetricsServer::~CMetricsServer()
+{
+   Close();
+}
+
+// Starts serving snapshots on a Unix socket and/or to a file, either may be
+// empty.  Formatter is only ever called from the server thread.
+bool CMetricsServer::Open(const std::string& SocketPath, const std::string& SnapshotFile, TFormatter Formatter)
+{
+   if (mRunning || (SocketPath.empty() && SnapshotFile.empty()))
+      return false;
+
+   mSocketPath = SocketPath;
+   mSnapshotFile = SnapshotFile;
+   mFormatter = Formatter;
+
+   if (!mSocketPath.empty())
+   {
+      struct sockaddr_un address = {};
+
+      if (mSocketPath.size() >= sizeof(address.sun_path))
+      {
+         fprintf(stderr, "CMetricsServer::Open(): socket path too long\n");
+         return false;
+      }
+
+      address.sun_family = AF_UNIX;
+      strcpy(address.sun_path, mSocketPath.c_str());
+
+      // a stale socket from an earlier run
+      unlink(mSocketPath.c_str());
+
+      mListen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+      if (mListen < 0 ||
+          bind(mListen, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+          listen(mListen, 8) < 0)
+      {
+         perror("CMetricsServer::Open()");
+
+         if (mListen >= 0)
+            close(mListen);
+         mListen = -1;
+
+         return false;
+      }
+   }
+
+   mRunning = true;
+   mThread = std::thread(&CMetricsServer::Run, this);
+
+   return true;
+}
+
+void CMetricsServer::Close()
+{
+   if (!mRunning)
+      return;
+
+   mRunning = false;
+   mThread.join();
+
+   // leave a final snapshot behind
+   if (!mSnapshotFile.empty())
+      Snapshot();
+
+   if (mListen >= 0)
+   {
+      close(mListen);
+      unlink(mSocketPath.c_str());
+      mListen = -1;
+   }
+}
+
+void CMetricsServer::Snapshot()
+{
+   double now = CSimTimer::GetCurrentTime();
+
+   mText.clear();
+   AppendMetric(mText, "time %.6f\n", CSimTimer::GetRealTime());
+   mFormatter(mText, now);
+
+   if (!mSnapshotFile.empty())
+   {
+      std::string temp = mSnapshotFile + ".tmp";
+      FILE*       file = fopen(temp.c_str(), "w");
+
+      if (file)
+      {
+         bool status = (fwrite(mText.data(), 1, mText.size(), file) == mText.size());
+
+         if (fclose(file) == 0 && status)
+            rename(temp.c_str(), mSnapshotFile.c_str());
+      }
+   }
+}
+
+void CMetricsServer::Run()
+{
+   double next_snapshot = CSimTimer::GetCurrentTime();
+
+   while (mRunning)
+   {
+      double now = CSimTimer::GetCurrentTime();
+
+      if (now >= next_snapshot)
+      {
+         Snapshot();
+         next_snapshot = now + INTERVAL;
+      }
+
+      if (mListen < 0)
+      {
+         usleep(100000);
+         continue;
+      }
+
+      struct pollfd pfd = { mListen, POLLIN, 0 };
+
+      if (poll(&pfd, 1, 100) <= 0)
+         continue;
+
+      int client = accept4(mListen, NULL, NULL, SOCK_CLOEXEC);
+
+      if (client < 0)
+         continue;
+
+      // a client that has gone or is not reading gets nothing, rather than
+      // a SIGPIPE or a stalled server
+      if (send(client, mText.data(), mText.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0 &&
+          errno != EPIPE && errno != ECONNRESET && errno != EAGAIN)
+         perror("CMetricsServer: send()");
+
+      close(client);
+   }
+}
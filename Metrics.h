@@ -0,0 +1,164 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Metrics
+//  Class:      C++ Header
+//  Filename:   Metrics.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CLatencyHistogram
+//! \brief Power of 2 nanosecond latency histogram with one writer thread
+//!
+//! \class CStreamMetricsTable
+//! \brief Packet and byte counters for each stream, summed per source and group
+//!
+//! \class CMetricsServer
+//! \brief Serves a text snapshot of the metrics
+//!
+//! Counters are only written by the one thread that handles the packet, with
+//! relaxed loads and stores (no locked instructions), and read by the server
+//! thread.  The server formats a snapshot every INTERVAL seconds, writes it
+//! to the snapshot file (through a rename so readers never see half of it)
+//! and hands the latest one to anything that connects to its Unix socket:
+//!
+//!    nc -U /tmp/recorder.sock
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <netinet/in.h>
+
+class CLatencyHistogram
+{
+public:
+   static constexpr int NUM_BINS = 64; // bin b holds [2^b, 2^(b+1)) ns
+
+   CLatencyHistogram();
+
+   void Add(double Seconds)
+   {
+      uint64_t ns = (Seconds > 0.0) ? (uint64_t)(Seconds * 1e9) : 0;
+      int      bin = 63 - __builtin_clzll(ns | 1);
+
+      mBins[bin].store(mBins[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+      if (ns > mMax.load(std::memory_order_relaxed))
+         mMax.store(ns, std::memory_order_relaxed);
+   }
+
+private:
+   friend struct TLatencySnapshot;
+
+   std::atomic<uint64_t> mBins[NUM_BINS];
+   std::atomic<uint64_t> mMax;
+};
+
+//! Sum of one or more histograms, taken by the server thread
+struct TLatencySnapshot
+{
+   uint64_t bins[CLatencyHistogram::NUM_BINS];
+   uint64_t count;
+   uint64_t max;
+
+   TLatencySnapshot();
+
+   void     Add(const CLatencyHistogram& Histogram);
+   uint64_t Percentile(double Fraction) const;
+   void     Format(std::string& Text, const char* Name) const;
+};
+
+//! Counters for one stream, on their own cache line
+struct alignas(64) TStreamMetrics
+{
+   struct in_addr        from_ip;
+   struct in_addr        to_mcast_ip;
+   std::atomic<uint64_t> packets;
+   std::atomic<uint64_t> bytes;
+
+   // previous snapshot, only used by the server thread
+   uint64_t              prev_packets;
+   uint64_t              prev_bytes;
+
+   void Count(uint64_t Bytes)
+   {
+      packets.store(packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      bytes.store(bytes.load(std::memory_order_relaxed) + Bytes, std::memory_order_relaxed);
+   }
+};
+
+class CStreamMetricsTable
+{
+public:
+   explicit CStreamMetricsTable(uint32_t Capacity);
+   ~CStreamMetricsTable();
+
+   CStreamMetricsTable(const CStreamMetricsTable&) = delete;
+   CStreamMetricsTable& operator=(const CStreamMetricsTable&) = delete;
+
+   TStreamMetrics* Add(struct in_addr FromIp, struct in_addr ToMcastIp);
+
+   uint32_t GetCount() const { return mCount.load(std::memory_order_acquire); }
+   uint64_t GetPackets() const;
+   uint64_t GetBytes() const;
+
+   void Format(std::string& Text, double Now);
+
+private:
+   TStreamMetrics*       mStreams;
+   uint32_t              mCapacity;
+   std::atomic<uint32_t> mCount;
+   double                mPrevTime; // previous Format, only used by the server thread
+};
+
+class CMetricsServer
+{
+public:
+   static constexpr double INTERVAL = 1.0;
+
+   typedef std::function<void(std::string& Text, double Now)> TFormatter;
+
+   CMetricsServer();
+   ~CMetricsServer();
+
+   bool Open(const std::string& SocketPath, const std::string& SnapshotFile, TFormatter Formatter);
+   void Close();
+
+   bool IsOpen() const { return mRunning; }
+
+private:
+   void Run();
+   void Snapshot();
+
+   std::string       mSocketPath;
+   std::string       mSnapshotFile;
+   TFormatter        mFormatter;
+   std::string       mText;     // latest snapshot
+   int               mListen;
+   std::atomic<bool> mRunning;
+   std::thread       mThread;
+};
+
+void AppendMetric(std::string& Text, const char* Format, ...) __attribute__((format(printf, 2, 3)));
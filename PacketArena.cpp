@@ -0,0 +1,146 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Packet Arena
+//  Class:      C++ Source
+//  Filename:   PacketArena.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include "PacketArena.h"
+
+CPacketArena::CPacketArena(size_t SlabSize, int NumSlabs)
+   : mFreeSlabs(NumSlabs)
+{
+   mNumSlabs = NumSlabs;
+   mSlabs = new TPacketSlab[NumSlabs];
+   mExhausted = 0;
+   mReleaseSlab = nullptr;
+   mReleaseCount = 0;
+
+   for (int i = 0; i < NumSlabs; i++)
+   {
+      mSlabs[i].arena = this;
+      mSlabs[i].data = (char*)aligned_alloc(4096, SlabSize);
+      mSlabs[i].size = SlabSize;
+      mSlabs[i].used = 0;
+      mSlabs[i].refs = 0;
+   }
+
+   // the receive thread starts out owning the first slab, the rest are free
+   mCurrent = &mSlabs[0];
+   mCurrent->refs = 1;
+
+   for (int i = 1; i < NumSlabs; i++)
+      *mFreeSlabs.WriteSlot(i - 1) = &mSlabs[i];
+   mFreeSlabs.Commit(NumSlabs - 1);
+}
+
+CPacketArena::~CPacketArena()
+{
+   for (int i = 0; i < mNumSlabs; i++)
+      free(mSlabs[i].data);
+
+   delete [] mSlabs;
+}
+
+// Returns Bytes of contiguous space in the current slab, moving on to a free
+// slab if the current one is full.  Returns nullptr if every slab is still
+// waiting on the writer.
+char* CPacketArena::Reserve(size_t Bytes)
+{
+   if (mCurrent && mCurrent->used + Bytes <= mCurrent->size)
+      return mCurrent->data + mCurrent->used;
+
+   if (mCurrent)
+   {
+      TPacketSlab* slab = mCurrent;
+
+      mCurrent = nullptr;
+
+      // drop the receive thread's hold, if the writer already released
+      // everything in it the slab can be reused right away
+      if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+         mCurrent = slab;
+   }
+
+   if (!mCurrent && mFreeSlabs.ReadAvailable() > 0)
+   {
+      mCurrent = *mFreeSlabs.ReadSlot(0);
+      mFreeSlabs.Release(1);
+   }
+
+   if (!mCurrent)
+   {
+      mExhausted.store(mExhausted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return nullptr;
+   }
+
+   mCurrent->used = 0;
+   mCurrent->refs.store(1, std::memory_order_relaxed);
+
+   if (Bytes > mCurrent->size)
+      return nullptr;
+
+   return mCurrent->data;
+}
+
+// Marks Bytes of the last reservation as used by NumRecords records
+void CPacketArena::Commit(size_t Bytes, uint32_t NumRecords)
+{
+   mCurrent->used += Bytes;
+   mCurrent->refs.fetch_add(NumRecords, std::memory_order_relaxed);
+}
+
+// Called by the writer once a record is on disk.  Consecutive releases from
+// the same slab are counted up and applied together.
+void CPacketArena::Release(TPacketRecord* Record)
+{
+   if (Record->slab != mReleaseSlab)
+   {
+      Flush();
+      mReleaseSlab = Record->slab;
+   }
+
+   mReleaseCount++;
+}
+
+void CPacketArena::Flush()
+{
+   if (mReleaseSlab && mReleaseCount)
+      Unref(mReleaseSlab, mReleaseCount);
+
+   mReleaseSlab = nullptr;
+   mReleaseCount = 0;
+}
+
+void CPacketArena::Unref(TPacketSlab* Slab, uint32_t Count)
+{
+   // last reference gone, give the slab back to the receive thread
+   if (Slab->refs.fetch_sub(Count, std::memory_order_acq_rel) == Count)
+   {
+      *mFreeSlabs.WriteSlot(0) = Slab;
+      mFreeSlabs.Commit(1);
+   }
+}
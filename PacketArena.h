@@ -0,0 +1,121 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Packet Arena
+//  Class:      C++ Header
+//  Filename:   PacketArena.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPacketArena
+//! \brief Slab allocator for variable length packet records
+//!
+//! The receive thread carves TPacketRecords (header + exact payload) out of
+//! large slabs and the writer thread releases them once they are on disk.
+//! Each slab is reference counted; when the last record in a slab that the
+//! receive thread has moved past is released, the writer hands the slab back
+//! to the receive thread through a CPacketRing so the two threads never share
+//! a lock.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "RecordFile.h"
+#include "PacketRing.h"
+
+class CPacketArena;
+
+struct TPacketSlab
+{
+   CPacketArena*         arena; // owner, records are released back to it
+   char*                 data;
+   size_t                size;
+   size_t                used;
+   std::atomic<uint32_t> refs; // records not yet released, plus one while the receive thread owns it
+};
+
+//! One received datagram.  The payload follows the record in memory, and
+//! header + payload are laid out exactly as a version 2 .bin record so the
+//! writer can hand them to the disk in one piece.  A record turned into a
+//! reference holds its TRecordReference in place of the payload.
+struct TPacketRecord
+{
+   TPacketSlab*   slab;
+   struct in_addr from_ip;
+   struct in_addr to_mcast_ip;
+   TRecordHeader  header;
+
+   char*       Payload() { return (char*)(this + 1); }
+   const char* DiskData() const { return (const char*)&header; }
+   size_t      DiskBytes() const { return sizeof(TRecordHeader) + GetRecordBodySize(header); }
+};
+
+class CPacketArena
+{
+public:
+   static constexpr size_t ALIGNMENT = 8;
+
+   CPacketArena(size_t SlabSize, int NumSlabs);
+   ~CPacketArena();
+
+   CPacketArena(const CPacketArena&) = delete;
+   CPacketArena& operator=(const CPacketArena&) = delete;
+
+   // Receive thread
+
+   char* Reserve(size_t Bytes);
+   void  Commit(size_t Bytes, uint32_t NumRecords);
+
+   static size_t RecordSize(size_t PayloadBytes)
+   {
+      return (sizeof(TPacketRecord) + PayloadBytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+   }
+
+   TPacketSlab* CurrentSlab() const { return mCurrent; }
+
+   // Writer thread
+
+   void Release(TPacketRecord* Record);
+   void Flush();
+
+   // Statistics
+
+   uint64_t Exhausted() const { return mExhausted.load(std::memory_order_relaxed); }
+   int      NumSlabs() const { return mNumSlabs; }
+
+private:
+   void Unref(TPacketSlab* Slab, uint32_t Count);
+
+   TPacketSlab*              mSlabs;
+   int                       mNumSlabs;
+   CPacketRing<TPacketSlab*> mFreeSlabs;
+
+   // owned by the receive thread
+   TPacketSlab*              mCurrent;
+   std::atomic<uint64_t>     mExhausted;
+
+   // owned by the writer thread, releases are batched per slab
+   TPacketSlab*              mReleaseSlab;
+   uint32_t                  mReleaseCount;
+};
@@ -0,0 +1,343 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Packet Capture
+//  Class:      C++ Source
+//  Filename:   PacketCapture.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <algorithm>
+#include "PacketCapture.h"
+
+CPacketCapture::CPacketCapture()
+{
+   mSocket = -1;
+   mRing = nullptr;
+   mRingSize = 0;
+   mBlock = 0;
+   mDesc = nullptr;
+   mPacket = nullptr;
+   mPacketsLeft = 0;
+   mPort = 0;
+   mNetwork = 0;
+   mMask = 0;
+   mKernelDrops = 0;
+}
+
+CPacketCapture::~CPacketCapture()
+{
+   Close();
+}
+
+// Finds the name of the interface that has IpAddress
+bool CPacketCapture::FindInterface(const char* IpAddress, std::string& Name)
+{
+   struct ifaddrs* interfaces;
+   in_addr_t       address = inet_addr(IpAddress);
+   bool            found = false;
+
+   if (getifaddrs(&interfaces) != 0)
+      return false;
+
+   for (struct ifaddrs* i = interfaces; i && !found; i = i->ifa_next)
+   {
+      if (i->ifa_addr && i->ifa_addr->sa_family == AF_INET &&
+          ((struct sockaddr_in*)i->ifa_addr)->sin_addr.s_addr == address)
+      {
+         Name = i->ifa_name;
+         found = true;
+      }
+   }
+
+   freeifaddrs(interfaces);
+
+   return found;
+}
+
+// Opens the capture on Interface for UDP to Port on Network/PrefixBits.
+// Several captures with the same non-zero FanoutGroup share the traffic,
+// split by flow so each stream stays on one of them.
+bool CPacketCapture::Open(const char* Interface, int Port, const char* Network, int PrefixBits, int FanoutGroup)
+{
+   struct tpacket_req3 request = {};
+   struct sockaddr_ll  address = {};
+   int                 version = TPACKET_V3;
+
+   if (mSocket >= 0)
+      return true;
+
+   mPort = Port;
+   mMask = (PrefixBits <= 0) ? 0 : ~0u << (32 - PrefixBits);
+   mNetwork = ntohl(inet_addr(Network)) & mMask;
+
+   // Offsets are from the IP header, a SOCK_DGRAM packet socket has no link
+   // layer header.  Drop what this host sent, anything but UDP, fragments
+   // and other destinations.
+   struct sock_filter code[] =
+   {
+      BPF_STMT(BPF_LD  | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_PKTTYPE)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 11, 0),
+      BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 9),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 9),
+      BPF_STMT(BPF_LD  | BPF_H | BPF_ABS, 6),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, 7, 0),
+      BPF_STMT(BPF_LD  | BPF_W | BPF_ABS, 16),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, mMask),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mNetwork, 0, 4),
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+      BPF_STMT(BPF_LD  | BPF_H | BPF_IND, 2),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)Port, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0x40000),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+   };
+   struct sock_fprog filter = { sizeof(code) / sizeof(code[0]), code };
+
+   mSocket = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, htons(ETH_P_IP));
+
+   if (mSocket < 0)
+   {
+      perror("CPacketCapture::Open(): socket()");
+      return false;
+   }
+
+   if (setsockopt(mSocket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+       setsockopt(mSocket, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0)
+   {
+      perror("CPacketCapture::Open(): setsockopt()");
+      Close();
+      return false;
+   }
+
+   request.tp_block_size = BLOCK_BYTES;
+   request.tp_block_nr = NUM_BLOCKS;
+   request.tp_frame_size = FRAME_SIZE;
+   request.tp_frame_nr = (BLOCK_BYTES / FRAME_SIZE) * NUM_BLOCKS;
+   request.tp_retire_blk_tov = BLOCK_MS;
+   request.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+   if (setsockopt(mSocket, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0)
+   {
+      perror("CPacketCapture::Open(): PACKET_RX_RING");
+      Close();
+      return false;
+   }
+
+   mRingSize = (size_t)BLOCK_BYTES * NUM_BLOCKS;
+   mRing = (char*)mmap(NULL, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, mSocket, 0);
+
+   // locking the ring needs CAP_IPC_LOCK or a high enough limit
+   if (mRing == MAP_FAILED)
+      mRing = (char*)mmap(NULL, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mSocket, 0);
+
+   if (mRing == MAP_FAILED)
+   {
+      perror("CPacketCapture::Open(): mmap()");
+      mRing = nullptr;
+      Close();
+      return false;
+   }
+
+   address.sll_family = AF_PACKET;
+   address.sll_protocol = htons(ETH_P_IP);
+   address.sll_ifindex = if_nametoindex(Interface);
+
+   if (address.sll_ifindex == 0 || bind(mSocket, (struct sockaddr*)&address, sizeof(address)) < 0)
+   {
+      fprintf(stderr, "CPacketCapture::Open(): cannot capture on %s: %s\n", Interface, strerror(errno));
+      Close();
+      return false;
+   }
+
+   if (FanoutGroup)
+   {
+      int fanout = (FanoutGroup & 0xffff) | (PACKET_FANOUT_HASH << 16);
+
+      if (setsockopt(mSocket, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+      {
+         perror("CPacketCapture::Open(): PACKET_FANOUT");
+         Close();
+         return false;
+      }
+   }
+
+   mBlock = 0;
+   mDesc = nullptr;
+   mPacketsLeft = 0;
+   mKernelDrops = 0;
+
+   return true;
+}
+
+void CPacketCapture::Close()
+{
+   if (mRing)
+      munmap(mRing, mRingSize);
+
+   if (mSocket >= 0)
+      close(mSocket);
+
+   mRing = nullptr;
+   mSocket = -1;
+   mDesc = nullptr;
+   mPacketsLeft = 0;
+}
+
+// Takes the next block if the kernel has handed it over, waiting up to
+// TimeoutMs for it
+bool CPacketCapture::NextBlock(int TimeoutMs)
+{
+   struct tpacket_block_desc* desc = (struct tpacket_block_desc*)(mRing + (size_t)mBlock * BLOCK_BYTES);
+
+   if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+   {
+      struct pollfd pfd = { mSocket, POLLIN | POLLERR, 0 };
+
+      if (TimeoutMs == 0 || poll(&pfd, 1, TimeoutMs) <= 0)
+         return false;
+
+      if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+         return false;
+   }
+
+   mDesc = desc;
+   mPacket = (const struct tpacket3_hdr*)((char*)desc + desc->hdr.bh1.offset_to_first_pkt);
+   mPacketsLeft = desc->hdr.bh1.num_pkts;
+
+   return true;
+}
+
+// Gives the current block back to the kernel, and picks up its drop count
+// once per block
+void CPacketCapture::ReleaseBlock()
+{
+   struct tpacket_stats_v3 stats = {};
+   socklen_t               length = sizeof(stats);
+
+   __atomic_store_n(&mDesc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+   mDesc = nullptr;
+   mPacketsLeft = 0;
+   mBlock = (mBlock + 1) % NUM_BLOCKS;
+
+   // the kernel clears its counters on every read
+   if (getsockopt(mSocket, SOL_PACKET, PACKET_STATISTICS, &stats, &length) == 0)
+      mKernelDrops += stats.tp_drops;
+}
+
+// Checks the headers of one captured packet and fills in Packet, the payload
+// is copied into the caller's buffer and spill
+bool CPacketCapture::Parse(const struct tpacket3_hdr* Header, TUdpPacket& Packet) const
+{
+   const struct sockaddr_ll* link = (const struct sockaddr_ll*)((const char*)Header + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+   const char*               data = (const char*)Header + Header->tp_net;
+   uint32_t                  length = Header->tp_snaplen;
+   struct iphdr              ip;
+   struct udphdr             udp;
+
+   if (link->sll_pkttype == PACKET_OUTGOING || length < sizeof(ip))
+      return false;
+
+   memcpy(&ip, data, sizeof(ip));
+
+   uint32_t ip_bytes = ip.ihl * 4;
+
+   if (ip.version != 4 || ip.protocol != IPPROTO_UDP || ip_bytes < sizeof(ip) || length < ip_bytes + sizeof(udp) ||
+       (ntohs(ip.frag_off) & 0x3fff) != 0 || (ntohl(ip.daddr) & mMask) != mNetwork)
+      return false;
+
+   memcpy(&udp, data + ip_bytes, sizeof(udp));
+
+   if (ntohs(udp.dest) != mPort || ntohs(udp.len) < sizeof(udp))
+      return false;
+
+   // never trust the UDP length past what was captured
+   uint32_t    bytes = std::min<uint32_t>(ntohs(udp.len) - sizeof(udp), length - ip_bytes - sizeof(udp));
+   const char* payload = data + ip_bytes + sizeof(udp);
+   uint32_t    first = std::min<uint32_t>(bytes, Packet.max_bytes);
+   uint32_t    rest = std::min<uint32_t>(bytes - first, Packet.spill ? Packet.spill_bytes : 0);
+
+   memcpy(Packet.buffer, payload, first);
+
+   if (rest)
+      memcpy(Packet.spill, payload + first, rest);
+
+   Packet.bytes = first + rest;
+   Packet.from_ip.s_addr = ip.saddr;
+   Packet.to_mcast_ip.s_addr = ip.daddr;
+   Packet.rx_time.tv_sec = Header->tp_sec;
+   Packet.rx_time.tv_nsec = Header->tp_nsec;
+
+   return true;
+}
+
+// Fills up to NumPackets slots from the ring, waiting up to WAIT_MS for the
+// first one.  Returns the number filled, 0 if nothing arrived.
+int CPacketCapture::ReceiveBatch(TUdpPacket* Packets, int NumPackets)
+{
+   int count = 0;
+
+   if (mSocket < 0)
+      return -1;
+
+   if (NumPackets > CSimUdpSocket::MAX_BATCH)
+      NumPackets = CSimUdpSocket::MAX_BATCH;
+
+   while (count < NumPackets)
+   {
+      if (!mDesc && !NextBlock(count == 0 ? WAIT_MS : 0))
+         break;
+
+      // the kernel retires empty blocks on timeout
+      if (mPacketsLeft == 0)
+      {
+         ReleaseBlock();
+         continue;
+      }
+
+      if (Parse(mPacket, Packets[count]))
+         count++;
+
+      mPacket = (const struct tpacket3_hdr*)((const char*)mPacket + mPacket->tp_next_offset);
+
+      // hand the block back as soon as it is used up
+      if (--mPacketsLeft == 0)
+         ReleaseBlock();
+   }
+
+   return count;
+}
@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Packet Capture
+//  Class:      C++ Header
+//  Filename:   PacketCapture.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPacketCapture
+//! \brief AF_PACKET TPACKET_V3 capture of the recorded UDP traffic
+//!
+//! An alternative to receiving on a UDP socket for the heaviest captures.
+//! The kernel fills blocks of a ring mapped into the process and hands over
+//! a whole block at a time, so there is no system call per datagram and no
+//! socket buffer to overflow.  A BPF filter keeps only UDP to one port on
+//! one group network, and the IP/UDP headers are parsed in place.
+//!
+//! ReceiveBatch fills the same TUdpPacket slots as CSimUdpSocket, copying
+//! the payload out of the ring into the caller's buffers.
+//!
+//! The capture does not join groups, a UDP socket still has to do that so
+//! the switch forwards them.  Datagrams that were fragmented on the wire
+//! are not captured.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include "SimUdpSocket.h"
+
+enum eCaptureBackend {CAPTURE_SOCKET, CAPTURE_PACKET};
+
+class CPacketCapture
+{
+public:
+   static constexpr uint32_t BLOCK_BYTES = 1 << 20;
+   static constexpr uint32_t NUM_BLOCKS = 64;
+   static constexpr uint32_t FRAME_SIZE = 2048;
+   static constexpr int      BLOCK_MS   = 10;  // longest the kernel holds a block that is not full
+   static constexpr int      WAIT_MS    = 100; // longest ReceiveBatch waits for a block
+
+   CPacketCapture();
+   ~CPacketCapture();
+
+   CPacketCapture(const CPacketCapture&) = delete;
+   CPacketCapture& operator=(const CPacketCapture&) = delete;
+
+   static bool FindInterface(const char* IpAddress, std::string& Name);
+
+   bool Open(const char* Interface, int Port, const char* Network, int PrefixBits, int FanoutGroup);
+   void Close();
+
+   int  ReceiveBatch(TUdpPacket* Packets, int NumPackets);
+
+   bool IsOpen() const { return mSocket >= 0; }
+
+   // datagrams the kernel dropped so far, wraps at 2^32 like SO_RXQ_OVFL
+   uint32_t GetKernelDrops() const { return mKernelDrops; }
+
+private:
+   bool NextBlock(int TimeoutMs);
+   void ReleaseBlock();
+   bool Parse(const struct tpacket3_hdr* Header, TUdpPacket& Packet) const;
+
+   int                            mSocket;
+   char*                          mRing;
+   size_t                         mRingSize;
+   uint32_t                       mBlock;       // current block
+   struct tpacket_block_desc*     mDesc;        // current block while it is ours, else NULL
+   const struct tpacket3_hdr*     mPacket;      // next packet in the current block
+   uint32_t                       mPacketsLeft;
+   int                            mPort;
+   uint32_t                       mNetwork;     // host order
+   uint32_t                       mMask;
+   uint32_t                       mKernelDrops;
+};
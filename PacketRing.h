@@ -0,0 +1,231 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Packet Ring
+//  Class:      C++ Header
+//  Filename:   PacketRing.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPacketRing
+//! \brief Bounded single producer / single consumer lock-free ring
+//!
+//! The producer fills slots in place (WriteSlot) and publishes them with
+//! Commit, the consumer reads them in place (ReadSlot) and hands them back
+//! with Release.  Neither side ever blocks the other.  When the ring is full
+//! the producer counts the packets it could not store as overflows.
+//!
+//! The consumer sleeps on an eventfd (Wait, or WaitAny across several rings)
+//! and the producer only pays for the write() to wake it (Notify) when the
+//! consumer is actually asleep.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+template <typename T>
+class CPacketRing
+{
+public:
+   static constexpr int CACHE_LINE = 64;
+   static constexpr int MAX_WAIT   = 64; // most rings WaitAny can sleep on
+
+   explicit CPacketRing(uint32_t Capacity)
+   {
+      // round up to a power of two so indices can be masked
+      mCapacity = 1;
+      while (mCapacity < Capacity)
+         mCapacity <<= 1;
+      mMask = mCapacity - 1;
+
+      mSlots = new T[mCapacity];
+      mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+      mHead = 0;
+      mTail = 0;
+      mProducerHead = 0;
+      mConsumerTail = 0;
+      mWaiting = false;
+      mOverflows = 0;
+      mHighWater = 0;
+   }
+
+   ~CPacketRing()
+   {
+      delete [] mSlots;
+      close(mEventFd);
+   }
+
+   CPacketRing(const CPacketRing&) = delete;
+   CPacketRing& operator=(const CPacketRing&) = delete;
+
+   uint32_t Capacity() const { return mCapacity; }
+
+   // Producer side
+
+   uint32_t WriteAvailable()
+   {
+      uint32_t tail = mTail.load(std::memory_order_relaxed);
+
+      // only go to the shared head when the cached copy says we are full
+      if (tail - mProducerHead == mCapacity)
+         mProducerHead = mHead.load(std::memory_order_acquire);
+
+      return mCapacity - (tail - mProducerHead);
+   }
+
+   T* WriteSlot(uint32_t Index)
+   {
+      return &mSlots[(mTail.load(std::memory_order_relaxed) + Index) & mMask];
+   }
+
+   void Commit(uint32_t Count)
+   {
+      mTail.store(mTail.load(std::memory_order_relaxed) + Count, std::memory_order_release);
+   }
+
+   void AddOverflows(uint64_t Count)
+   {
+      mOverflows.store(mOverflows.load(std::memory_order_relaxed) + Count, std::memory_order_relaxed);
+   }
+
+   // Wake the consumer if it is sleeping in Wait().  Safe to call from a
+   // signal handler.
+   void Notify()
+   {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (mWaiting.load(std::memory_order_relaxed))
+         Wakeup();
+   }
+
+   void Wakeup()
+   {
+      uint64_t one = 1;
+      ssize_t  status = write(mEventFd, &one, sizeof(one));
+      (void)status;
+   }
+
+   // Consumer side
+
+   uint32_t ReadAvailable()
+   {
+      uint32_t head = mHead.load(std::memory_order_relaxed);
+
+      if (mConsumerTail == head)
+      {
+         mConsumerTail = mTail.load(std::memory_order_acquire);
+
+         if (mConsumerTail - head > mHighWater.load(std::memory_order_relaxed))
+            mHighWater.store(mConsumerTail - head, std::memory_order_relaxed);
+      }
+
+      return mConsumerTail - head;
+   }
+
+   T* ReadSlot(uint32_t Index)
+   {
+      return &mSlots[(mHead.load(std::memory_order_relaxed) + Index) & mMask];
+   }
+
+   void Release(uint32_t Count)
+   {
+      mHead.store(mHead.load(std::memory_order_relaxed) + Count, std::memory_order_release);
+   }
+
+   // Sleep until the producer commits something or TimeoutMs expires
+   void Wait(int TimeoutMs)
+   {
+      CPacketRing* ring = this;
+
+      WaitAny(&ring, 1, TimeoutMs);
+   }
+
+   // Sleep until the producer of any of Rings commits something, for a
+   // consumer that drains several rings
+   static void WaitAny(CPacketRing* const* Rings, int NumRings, int TimeoutMs)
+   {
+      struct pollfd pfds[MAX_WAIT];
+      uint64_t      count;
+      bool          empty = true;
+
+      if (NumRings > MAX_WAIT)
+         NumRings = MAX_WAIT;
+
+      for (int i = 0; i < NumRings; i++)
+         Rings[i]->mWaiting.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      // re-check after advertising that we are asleep so a commit that raced
+      // with us is not missed
+      for (int i = 0; i < NumRings; i++)
+      {
+         empty &= (Rings[i]->ReadAvailable() == 0);
+
+         pfds[i].fd = Rings[i]->mEventFd;
+         pfds[i].events = POLLIN;
+         pfds[i].revents = 0;
+      }
+
+      if (empty)
+         poll(pfds, NumRings, TimeoutMs);
+
+      for (int i = 0; i < NumRings; i++)
+      {
+         Rings[i]->mWaiting.store(false, std::memory_order_relaxed);
+
+         // drain the eventfd counter
+         ssize_t status = read(Rings[i]->mEventFd, &count, sizeof(count));
+         (void)status;
+      }
+   }
+
+   // Statistics
+
+   uint32_t Depth() const
+   {
+      return mTail.load(std::memory_order_relaxed) - mHead.load(std::memory_order_relaxed);
+   }
+
+   uint64_t Overflows() const { return mOverflows.load(std::memory_order_relaxed); }
+   uint32_t HighWater() const { return mHighWater.load(std::memory_order_relaxed); }
+
+private:
+   T*       mSlots;
+   uint32_t mCapacity;
+   uint32_t mMask;
+   int      mEventFd;
+
+   // written by the consumer
+   alignas(CACHE_LINE) std::atomic<uint32_t> mHead;
+   uint32_t                                  mConsumerTail; // consumer's cached copy of mTail
+   std::atomic<bool>                         mWaiting;
+   std::atomic<uint32_t>                     mHighWater;
+
+   // written by the producer
+   alignas(CACHE_LINE) std::atomic<uint32_t> mTail;
+   uint32_t                                  mProducerHead; // producer's cached copy of mHead
+   std::atomic<uint64_t>                     mOverflows;
+};
@@ -0,0 +1,166 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Payload Store
+//  Class:      C++ Source
+//  Filename:   PayloadStore.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <string.h>
+#include "RecordFile.h"
+#include "PayloadStore.h"
+
+static constexpr uint64_t HASH_PRIME1 = 11400714785074694791ull;
+static constexpr uint64_t HASH_PRIME2 = 14029467366897019727ull;
+static constexpr uint64_t HASH_PRIME3 = 1609587929392839161ull;
+static constexpr uint64_t HASH_PRIME4 = 9650029242287828579ull;
+static constexpr uint64_t HASH_PRIME5 = 2870177450012600261ull;
+
+static inline uint64_t rotl64(uint64_t Value, int Bits)
+{
+   return (Value << Bits) | (Value >> (64 - Bits));
+}
+
+static inline uint64_t read64(const char* Data)
+{
+   uint64_t value;
+
+   memcpy(&value, Data, sizeof(value));
+   return value;
+}
+
+static inline uint64_t hash_round(uint64_t Acc, uint64_t Input)
+{
+   return rotl64(Acc + Input * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+static inline uint64_t hash_merge(uint64_t Hash, uint64_t Lane)
+{
+   return (Hash ^ hash_round(0, Lane)) * HASH_PRIME1 + HASH_PRIME4;
+}
+
+CPayloadStore::CPayloadStore()
+{
+   mReferences = 0;
+   mBytesSaved = 0;
+}
+
+CPayloadStore::~CPayloadStore()
+{
+}
+
+uint64_t CPayloadStore::Hash(const void* Data, size_t Bytes)
+{
+   const char* data = (const char*)Data;
+   const char* end = data + Bytes;
+   uint64_t    hash;
+
+   if (Bytes >= 32)
+   {
+      // four lanes with no dependency between them
+      uint64_t lane1 = HASH_PRIME1 + HASH_PRIME2;
+      uint64_t lane2 = HASH_PRIME2;
+      uint64_t lane3 = 0;
+      uint64_t lane4 = -HASH_PRIME1;
+
+      for (; data + 32 <= end; data += 32)
+      {
+         lane1 = hash_round(lane1, read64(data));
+         lane2 = hash_round(lane2, read64(data + 8));
+         lane3 = hash_round(lane3, read64(data + 16));
+         lane4 = hash_round(lane4, read64(data + 24));
+      }
+
+      hash = rotl64(lane1, 1) + rotl64(lane2, 7) + rotl64(lane3, 12) + rotl64(lane4, 18);
+      hash = hash_merge(hash, lane1);
+      hash = hash_merge(hash, lane2);
+      hash = hash_merge(hash, lane3);
+      hash = hash_merge(hash, lane4);
+   }
+   else
+   {
+      hash = HASH_PRIME5;
+   }
+
+   hash += Bytes;
+
+   for (; data + 8 <= end; data += 8)
+      hash = rotl64(hash ^ hash_round(0, read64(data)), 27) * HASH_PRIME1 + HASH_PRIME4;
+
+   if (data + 4 <= end)
+   {
+      uint32_t word;
+
+      memcpy(&word, data, sizeof(word));
+      hash = rotl64(hash ^ (word * HASH_PRIME1), 23) * HASH_PRIME2 + HASH_PRIME3;
+      data += 4;
+   }
+
+   for (; data < end; data++)
+      hash = rotl64(hash ^ ((uint8_t)*data * HASH_PRIME5), 11) * HASH_PRIME1;
+
+   // final mix
+   hash ^= hash >> 33;
+   hash *= HASH_PRIME2;
+   hash ^= hash >> 29;
+   hash *= HASH_PRIME3;
+   hash ^= hash >> 32;
+
+   return hash;
+}
+
+bool CPayloadStore::Find(const char* Payload, uint64_t Bytes, uint64_t& Offset)
+{
+   if (Bytes < MIN_BYTES || Bytes > MAX_BYTES)
+      return false;
+
+   auto entry = mEntries.find(Hash(Payload, Bytes));
+
+   // a different payload with the same hash is never referenced
+   if (entry == mEntries.end() || entry->second.bytes != Bytes ||
+       memcmp(mData.data() + entry->second.data, Payload, Bytes) != 0)
+      return false;
+
+   Offset = entry->second.offset;
+   mReferences++;
+   mBytesSaved += Bytes - sizeof(TRecordReference);
+
+   return true;
+}
+
+void CPayloadStore::Add(const char* Payload, uint64_t Bytes, uint64_t Offset)
+{
+   if (Bytes < MIN_BYTES || Bytes > MAX_BYTES)
+      return;
+
+   if (mData.size() + Bytes > MAX_CACHE_BYTES)
+   {
+      mEntries.clear();
+      mData.clear();
+   }
+
+   // the first payload with a hash keeps its slot
+   if (mEntries.emplace(Hash(Payload, Bytes), TEntry{ Offset, (uint32_t)mData.size(), (uint32_t)Bytes }).second)
+      mData.insert(mData.end(), Payload, Payload + Bytes);
+}
@@ -0,0 +1,82 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Payload Store
+//  Class:      C++ Header
+//  Filename:   PayloadStore.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPayloadStore
+//! \brief Finds payloads a stream has already written, for deduplication
+//!
+//! Keeps a copy of the recent payloads of one recorded stream keyed on their
+//! hash, with the file offset each was written at.  Find looks for an
+//! identical earlier payload the record can reference instead, Add notes a
+//! payload written whole as the copy later records can reference.
+//!
+//! Payloads are hashed 32 bytes at a time in four independent 64-bit lanes
+//! (the xxHash64 construction), so the lanes pipeline and vectorize, and a
+//! hash match is always confirmed with a compare.  The copies are capped at
+//! MAX_CACHE_BYTES per stream; when full the store starts over, which keeps
+//! it holding what the stream is sending now.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <unordered_map>
+
+class CPayloadStore
+{
+public:
+   static constexpr uint64_t MIN_BYTES       = 16;   // smaller payloads cost less than a reference
+   static constexpr uint64_t MAX_BYTES       = 9000; // larger payloads are not kept
+   static constexpr size_t   MAX_CACHE_BYTES = 256 * 1024;
+
+   CPayloadStore();
+   ~CPayloadStore();
+
+   static uint64_t Hash(const void* Data, size_t Bytes);
+
+   // Returns true and the offset of an identical payload written earlier
+   bool Find(const char* Payload, uint64_t Bytes, uint64_t& Offset);
+
+   // Keeps a payload written whole at Offset
+   void Add(const char* Payload, uint64_t Bytes, uint64_t Offset);
+
+   uint64_t GetReferences() const { return mReferences; }
+   uint64_t GetBytesSaved() const { return mBytesSaved; }
+
+private:
+   struct TEntry
+   {
+      uint64_t offset; // in the recording
+      uint32_t data;   // of the copy in mData
+      uint32_t bytes;
+   };
+
+   std::unordered_map<uint64_t, TEntry> mEntries;
+   std::vector<char>                    mData;
+   uint64_t                             mReferences;
+   uint64_t                             mBytesSaved;
+};
@@ -0,0 +1,498 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Pcapng Export
+//  Class:      C++ Source
+//  Filename:   PcapngExport.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include "PcapngExport.h"
+
+static constexpr uint32_t EXPORT_SHB_TYPE    = 0x0A0D0D0A;
+static constexpr uint32_t EXPORT_IDB_TYPE    = 0x00000001;
+static constexpr uint32_t EXPORT_EPB_TYPE    = 0x00000006;
+static constexpr uint32_t EXPORT_BYTE_ORDER  = 0x1A2B3C4D;
+static constexpr uint16_t EXPORT_LINK_ETHER  = 1;
+static constexpr uint16_t EXPORT_TSRESOL     = 9;  // if_tsresol option
+static constexpr uint32_t EXPORT_EPB_BYTES   = 32; // block header, fields and trailing length
+static constexpr uint32_t EXPORT_HEADERS     = 14 + 20 + 8; // Ethernet, IPv4 and UDP
+
+static inline void put16(char* Data, uint16_t Value) { memcpy(Data, &Value, sizeof(Value)); }
+static inline void put32(char* Data, uint32_t Value) { memcpy(Data, &Value, sizeof(Value)); }
+
+// Length of the enhanced packet block holding a Bytes payload
+static inline uint32_t block_length(uint64_t Bytes)
+{
+   return EXPORT_EPB_BYTES + ((EXPORT_HEADERS + Bytes + 3) & ~3u);
+}
+
+CPcapngExporter::CPcapngExporter()
+{
+   mRunning = nullptr;
+   mFailed = false;
+   mFd = -1;
+   mSourcePort = 0;
+   mDestinationPort = 0;
+   mWindowStart = -HUGE_VAL;
+   mWindowEnd = HUGE_VAL;
+   mPackets = 0;
+   mBytesWritten = 0;
+   mSkipped = 0;
+}
+
+CPcapngExporter::~CPcapngExporter()
+{
+   if (mFd >= 0)
+      close(mFd);
+}
+
+void CPcapngExporter::AddStream(CStreamReader* Reader, struct in_addr FromIp, struct in_addr ToMcastIp)
+{
+   std::unique_ptr<TExportStream> stream(new TExportStream(CHUNKS_PER_STREAM));
+
+   stream->reader = Reader;
+   stream->from_ip = FromIp;
+   stream->to_mcast_ip = ToMcastIp;
+   stream->done = false;
+   stream->has_pending = false;
+   stream->finished = false;
+   stream->ip_id = 0;
+   stream->current = nullptr;
+   stream->entry = 0;
+   stream->chunks.resize(CHUNKS_PER_STREAM);
+
+   // every chunk starts out free
+   for (auto& chunk : stream->chunks)
+   {
+      chunk.stream = stream.get();
+      chunk.bytes = 0;
+      chunk.data.reset(new char[CHUNK_BYTES]);
+      *stream->free.WriteSlot(0) = &chunk;
+      stream->free.Commit(1);
+   }
+
+   mStreams.push_back(std::move(stream));
+}
+
+void CPcapngExporter::SetPorts(uint16_t SourcePort, uint16_t DestinationPort)
+{
+   mSourcePort = SourcePort;
+   mDestinationPort = DestinationPort;
+}
+
+void CPcapngExporter::SetWindow(double Start, double End)
+{
+   mWindowStart = Start;
+   mWindowEnd = End;
+}
+
+bool CPcapngExporter::GetTimeRange(double& First, double& Last) const
+{
+   bool found = false;
+
+   for (const auto& stream : mStreams)
+   {
+      double first;
+      double last;
+
+      if (!stream->reader->GetTimeRange(first, last))
+         continue;
+
+      First = found ? std::min(First, first) : first;
+      Last = found ? std::max(Last, last) : last;
+      found = true;
+   }
+
+   return found;
+}
+
+bool CPcapngExporter::Export(const char* Filename, int NumThreads, const std::atomic<bool>& Running)
+{
+   std::vector<std::thread> decoders;
+   std::vector<TEntry>      heap;
+
+   mFd = open(Filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+   if (mFd < 0)
+   {
+      printf("Error: could not create %s: %s\n", Filename, strerror(errno));
+      return false;
+   }
+
+   mRunning = &Running;
+
+   if (!WriteHeader())
+      return false;
+
+   for (auto& stream : mStreams)
+   {
+      if (mWindowStart != -HUGE_VAL)
+         stream->finished = !stream->reader->Seek(mWindowStart);
+      else
+         stream->reader->Rewind();
+   }
+
+   NumThreads = std::max(1, std::min<int>(NumThreads, mStreams.size()));
+
+   for (int k = 0; k < NumThreads; k++)
+      decoders.emplace_back(&CPcapngExporter::DecodeThread, this, k, NumThreads);
+
+   for (uint32_t i = 0; i < mStreams.size(); i++)
+   {
+      if (NextChunk(*mStreams[i]))
+         heap.push_back({ mStreams[i]->current->entries[0].time, i });
+   }
+
+   std::make_heap(heap.begin(), heap.end(), TLater());
+
+   while (!heap.empty() && !mFailed && Running)
+   {
+      uint32_t       id = heap.front().stream;
+      TExportStream& stream = *mStreams[id];
+
+      std::pop_heap(heap.begin(), heap.end(), TLater());
+      heap.pop_back();
+
+      const TExportEntry& entry = stream.current->entries[stream.entry++];
+      char*               block = stream.current->data.get() + entry.offset;
+
+      // blocks that follow each other in a chunk go out in one iovec
+      if (!mIov.empty() && (char*)mIov.back().iov_base + mIov.back().iov_len == block)
+         mIov.back().iov_len += entry.length;
+      else
+         mIov.push_back({ block, entry.length });
+
+      mPackets++;
+
+      if (stream.entry == stream.current->entries.size())
+      {
+         mRetired.push_back(stream.current);
+         stream.current = nullptr;
+
+         if (!NextChunk(stream))
+            continue;
+      }
+
+      heap.push_back({ stream.current->entries[stream.entry].time, id });
+      std::push_heap(heap.begin(), heap.end(), TLater());
+
+      if (mIov.size() >= MAX_IOV)
+         Flush();
+   }
+
+   Flush();
+
+   // stops the decoders if the merge gave up early
+   if (!heap.empty())
+      mFailed = true;
+
+   for (auto& decoder : decoders)
+      decoder.join();
+
+   if (fdatasync(mFd) != 0 || close(mFd) != 0)
+      mFailed = true;
+   mFd = -1;
+
+   return !mFailed;
+}
+
+// Writes the section header and the one Ethernet interface, in our byte order
+bool CPcapngExporter::WriteHeader()
+{
+   char    header[28 + 32] = {};
+   int64_t section_length = -1; // not known up front
+   char*   idb = header + 28;
+
+   put32(header, EXPORT_SHB_TYPE);
+   put32(header + 4, 28);
+   put32(header + 8, EXPORT_BYTE_ORDER);
+   put16(header + 12, 1);
+   put16(header + 14, 0);
+   memcpy(header + 16, &section_length, sizeof(section_length));
+   put32(header + 24, 28);
+
+   put32(idb, EXPORT_IDB_TYPE);
+   put32(idb + 4, 32);
+   put16(idb + 8, EXPORT_LINK_ETHER);
+   put32(idb + 12, 0);               // no snap length
+   put16(idb + 16, EXPORT_TSRESOL);
+   put16(idb + 18, 1);
+   idb[20] = 9;                      // nanoseconds
+   put32(idb + 28, 32);              // after the end of options at 24
+
+   mIov.push_back({ header, sizeof(header) });
+
+   return Flush();
+}
+
+// Writes the gathered iovecs, then hands the chunks they pointed into back to
+// their decoders
+bool CPcapngExporter::Flush()
+{
+   struct iovec* iov = mIov.data();
+   int           count = mIov.size();
+
+   while (count > 0 && !mFailed)
+   {
+      ssize_t written = writev(mFd, iov, std::min(count, MAX_IOV));
+
+      if (written < 0)
+      {
+         if (errno == EINTR)
+            continue;
+
+         printf("Error: export write failed: %s\n", strerror(errno));
+         mFailed = true;
+         break;
+      }
+
+      mBytesWritten += written;
+
+      // step over what went out, a short write leaves part of an iovec
+      while (count > 0 && (size_t)written >= iov->iov_len)
+      {
+         written -= iov->iov_len;
+         iov++;
+         count--;
+      }
+
+      if (count > 0)
+      {
+         iov->iov_base = (char*)iov->iov_base + written;
+         iov->iov_len -= written;
+      }
+   }
+
+   mIov.clear();
+
+   for (TExportChunk* chunk : mRetired)
+   {
+      *chunk->stream->free.WriteSlot(0) = chunk;
+      chunk->stream->free.Commit(1);
+      chunk->stream->free.Notify();
+   }
+
+   mRetired.clear();
+
+   return !mFailed;
+}
+
+// Moves the merge on to the next chunk of Stream, waiting for its decoder.
+// Returns false at the end of the stream.
+bool CPcapngExporter::NextChunk(TExportStream& Stream)
+{
+   while (!mFailed && *mRunning)
+   {
+      if (Stream.full.ReadAvailable() > 0)
+      {
+         Stream.current = *Stream.full.ReadSlot(0);
+         Stream.full.Release(1);
+         Stream.entry = 0;
+
+         if (!Stream.current->entries.empty())
+            return true;
+
+         mRetired.push_back(Stream.current);
+         Stream.current = nullptr;
+         continue;
+      }
+
+      // done is only set after the last commit
+      if (Stream.done.load(std::memory_order_acquire) && Stream.full.ReadAvailable() == 0)
+         return false;
+
+      // the decoder may be waiting on the chunks the gathered writes point into
+      Flush();
+      Stream.full.Wait(WAIT_MS);
+   }
+
+   return false;
+}
+
+void CPcapngExporter::DecodeThread(int Id, int NumThreads)
+{
+   std::vector<TExportStream*>              streams;
+   std::vector<CPacketRing<TExportChunk*>*> rings;
+
+   for (size_t i = Id; i < mStreams.size(); i += NumThreads)
+      streams.push_back(mStreams[i].get());
+
+   while (!mFailed && *mRunning)
+   {
+      bool busy = false;
+
+      rings.clear();
+
+      for (TExportStream* stream : streams)
+      {
+         if (stream->done)
+            continue;
+
+         busy |= Decode(*stream);
+
+         if (!stream->done)
+            rings.push_back(&stream->free);
+      }
+
+      if (rings.empty())
+         break;
+
+      // every open stream is waiting for the merge to hand a chunk back
+      if (!busy)
+         CPacketRing<TExportChunk*>::WaitAny(rings.data(), rings.size(), WAIT_MS);
+   }
+}
+
+// Fills the next free chunk of Stream with whole blocks and passes it to the
+// merge.  Returns false if there was no free chunk.
+bool CPcapngExporter::Decode(TExportStream& Stream)
+{
+   TExportChunk* chunk;
+
+   if (Stream.free.ReadAvailable() == 0)
+      return false;
+
+   chunk = *Stream.free.ReadSlot(0);
+   Stream.free.Release(1);
+
+   chunk->bytes = 0;
+   chunk->entries.clear();
+
+   while (!Stream.finished)
+   {
+      if (!Stream.has_pending)
+      {
+         if (!Stream.reader->Next(Stream.pending) || Stream.pending.time > mWindowEnd)
+         {
+            Stream.finished = true;
+            break;
+         }
+
+         if (Stream.pending.bytes > MAX_PAYLOAD)
+         {
+            mSkipped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+         }
+
+         Stream.has_pending = true;
+      }
+
+      uint32_t length = block_length(Stream.pending.bytes);
+
+      if (chunk->bytes + length > CHUNK_BYTES)
+         break;
+
+      FormatPacket(Stream, Stream.pending, chunk->data.get() + chunk->bytes);
+      chunk->entries.push_back({ Stream.pending.time, chunk->bytes, length });
+      chunk->bytes += length;
+      Stream.has_pending = false;
+   }
+
+   *Stream.full.WriteSlot(0) = chunk;
+   Stream.full.Commit(1);
+
+   if (Stream.finished)
+      Stream.done.store(true, std::memory_order_release);
+
+   Stream.full.Notify();
+
+   return true;
+}
+
+// Formats Record as an enhanced packet block at Block
+void CPcapngExporter::FormatPacket(TExportStream& Stream, const TPlaybackRecord& Record, char* Block)
+{
+   uint32_t length = block_length(Record.bytes);
+   uint32_t captured = EXPORT_HEADERS + Record.bytes;
+   double   time = (Record.real_time != 0.0) ? Record.real_time : Record.time;
+   uint64_t ns = (time > 0.0) ? (uint64_t)llround(time * 1e9) : 0;
+   uint32_t group = ntohl(Stream.to_mcast_ip.s_addr);
+   uint32_t checksum = 0;
+   char*    ether = Block + 28;
+   char*    ip = ether + 14;
+   char*    udp = ip + 20;
+
+   put32(Block, EXPORT_EPB_TYPE);
+   put32(Block + 4, length);
+   put32(Block + 8, 0);                  // interface
+   put32(Block + 12, ns >> 32);
+   put32(Block + 16, (uint32_t)ns);
+   put32(Block + 20, captured);
+   put32(Block + 24, captured);
+
+   // group MAC 01:00:5e plus the low 23 bits of the group, source 02:00 plus
+   // the source address
+   ether[0] = 0x01;
+   ether[1] = 0x00;
+   ether[2] = 0x5e;
+   ether[3] = (group >> 16) & 0x7f;
+   ether[4] = (group >> 8) & 0xff;
+   ether[5] = group & 0xff;
+   ether[6] = 0x02;
+   ether[7] = 0x00;
+   memcpy(ether + 8, &Stream.from_ip.s_addr, 4);
+   put16(ether + 12, htons(0x0800));
+
+   ip[0] = 0x45;
+   ip[1] = 0;
+   put16(ip + 2, htons(20 + 8 + Record.bytes));
+   put16(ip + 4, htons(Stream.ip_id++));
+   put16(ip + 6, 0);
+   ip[8] = 32;                           // ttl of played back traffic
+   ip[9] = IPPROTO_UDP;
+   put16(ip + 10, 0);
+   memcpy(ip + 12, &Stream.from_ip.s_addr, 4);
+   memcpy(ip + 16, &Stream.to_mcast_ip.s_addr, 4);
+
+   for (int i = 0; i < 20; i += 2)
+   {
+      uint16_t word;
+
+      memcpy(&word, ip + i, sizeof(word));
+      checksum += word;
+   }
+
+   checksum = (checksum & 0xffff) + (checksum >> 16);
+   checksum = (checksum & 0xffff) + (checksum >> 16);
+   put16(ip + 10, ~checksum);
+
+   put16(udp, htons(mSourcePort));
+   put16(udp + 2, htons(mDestinationPort));
+   put16(udp + 4, htons(8 + Record.bytes));
+   put16(udp + 6, 0);                    // no checksum
+
+   memcpy(udp + 8, Record.payload, Record.bytes);
+
+   // zero the padding, then the trailing length
+   memset(udp + 8 + Record.bytes, 0, length - 4 - (28 + captured));
+   put32(Block + length - 4, length);
+}
@@ -0,0 +1,163 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Pcapng Export
+//  Class:      C++ Header
+//  Filename:   PcapngExport.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPcapngExporter
+//! \brief Converts recorded streams into one time ordered pcapng capture
+//!
+//! Every packet is written as an enhanced packet block on an Ethernet
+//! interface with nanosecond timestamps, behind synthesized Ethernet, IPv4
+//! and UDP headers (the group's multicast MAC, a locally administered source
+//! MAC made from the source address, no UDP checksum).  Packets are stamped
+//! with their recorded real time, or their recorded time in version 1 files
+//! that have none, and ordered by their recorded time like playback.
+//!
+//! Decode threads share out the streams and format whole blocks into fixed
+//! chunks, so the copying and the page faults of reading the recordings run
+//! in parallel.  Each stream owns CHUNKS_PER_STREAM chunks that go round
+//! between its decoder and the merge through a pair of CPacketRings, which
+//! bounds the memory used whatever the size of the recording.
+//!
+//! The merge keeps the next packet of every stream in a min-heap, like
+//! CPlaybackScheduler, and writes the blocks in order straight out of the
+//! chunks with writev, so a chunk goes back to its decoder once the writes
+//! pointing into it are done.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "RecordReader.h"
+#include "PacketRing.h"
+
+//! One block ready to be written
+struct TExportEntry
+{
+   double   time;   // recorded time, the merge order
+   uint32_t offset; // in the chunk
+   uint32_t length;
+};
+
+struct TExportStream;
+
+//! Consecutive blocks of one stream
+struct TExportChunk
+{
+   TExportStream*            stream; // owner
+   uint32_t                  bytes;  // used
+   std::vector<TExportEntry> entries;
+   std::unique_ptr<char[]>   data;
+};
+
+struct TExportStream
+{
+   CStreamReader*             reader;
+   struct in_addr             from_ip;
+   struct in_addr             to_mcast_ip;
+   CPacketRing<TExportChunk*> full;        // decoder to merge
+   CPacketRing<TExportChunk*> free;        // merge back to decoder
+   std::atomic<bool>          done;        // set once the last chunk is committed
+   std::vector<TExportChunk>  chunks;
+
+   // decoder side
+   TPlaybackRecord            pending;     // read but not yet formatted
+   bool                       has_pending;
+   bool                       finished;    // reader at the end of the window
+   uint16_t                   ip_id;
+
+   // merge side
+   TExportChunk*              current;
+   uint32_t                   entry;       // next entry of current
+
+   TExportStream(uint32_t NumChunks) : full(NumChunks), free(NumChunks) {}
+};
+
+class CPcapngExporter
+{
+public:
+   static constexpr uint32_t CHUNK_BYTES       = 256 * 1024;
+   static constexpr int      CHUNKS_PER_STREAM = 3;
+   static constexpr uint32_t MAX_PAYLOAD       = 65507; // most a UDP datagram carries
+   static constexpr int      MAX_IOV           = 1024;
+   static constexpr int      WAIT_MS           = 10;
+
+   CPcapngExporter();
+   ~CPcapngExporter();
+
+   void AddStream(CStreamReader* Reader, struct in_addr FromIp, struct in_addr ToMcastIp);
+   void SetPorts(uint16_t SourcePort, uint16_t DestinationPort);
+   void SetWindow(double Start, double End);
+
+   bool GetTimeRange(double& First, double& Last) const;
+
+   // Blocks until the capture is written or Running is cleared
+   bool Export(const char* Filename, int NumThreads, const std::atomic<bool>& Running);
+
+   uint64_t GetPackets() const { return mPackets; }
+   uint64_t GetBytesWritten() const { return mBytesWritten; }
+   uint64_t GetSkipped() const { return mSkipped; }
+
+private:
+   struct TEntry
+   {
+      double   time;
+      uint32_t stream;
+   };
+
+   // orders the heap so the earliest entry is on top
+   struct TLater
+   {
+      bool operator()(const TEntry& A, const TEntry& B) const
+      {
+         return A.time > B.time || (A.time == B.time && A.stream > B.stream);
+      }
+   };
+
+   void     DecodeThread(int Id, int NumThreads);
+   bool     Decode(TExportStream& Stream);
+   void     FormatPacket(TExportStream& Stream, const TPlaybackRecord& Record, char* Block);
+   bool     NextChunk(TExportStream& Stream);
+   bool     WriteHeader();
+   bool     Flush();
+
+   std::vector<std::unique_ptr<TExportStream>> mStreams;
+   std::vector<TExportChunk*>                  mRetired; // written out once the iovecs are
+   std::vector<struct iovec>                   mIov;
+   const std::atomic<bool>*                    mRunning;
+   std::atomic<bool>                           mFailed;
+   int                                         mFd;
+   uint16_t                                    mSourcePort;
+   uint16_t                                    mDestinationPort;
+   double                                      mWindowStart;
+   double                                      mWindowEnd;
+   uint64_t                                    mPackets;
+   uint64_t                                    mBytesWritten;
+   std::atomic<uint64_t>                       mSkipped;
+};
@@ -0,0 +1,530 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Pcapng Reader
+//  Class:      C++ Source
+//  Filename:   PcapngReader.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <byteswap.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <map>
+#include "PcapngReader.h"
+
+static constexpr uint32_t PCAPNG_SHB        = 0x0A0D0D0A;
+static constexpr uint32_t PCAPNG_IDB        = 0x00000001;
+static constexpr uint32_t PCAPNG_PB         = 0x00000002; // obsolete packet block
+static constexpr uint32_t PCAPNG_EPB        = 0x00000006;
+static constexpr uint32_t PCAPNG_BYTE_ORDER = 0x1A2B3C4D;
+
+static constexpr uint16_t LINK_NULL         = 0;
+static constexpr uint16_t LINK_ETHERNET     = 1;
+static constexpr uint16_t LINK_RAW          = 101;
+static constexpr uint16_t LINK_LOOP         = 108;
+static constexpr uint16_t LINK_LINUX_SLL    = 113;
+static constexpr uint16_t LINK_IPV4         = 228;
+static constexpr uint16_t LINK_LINUX_SLL2   = 276;
+
+static inline uint16_t read16(const char* Data, bool Swapped)
+{
+   uint16_t value;
+
+   memcpy(&value, Data, sizeof(value));
+
+   return Swapped ? bswap_16(value) : value;
+}
+
+static inline uint32_t read32(const char* Data, bool Swapped)
+{
+   uint32_t value;
+
+   memcpy(&value, Data, sizeof(value));
+
+   return Swapped ? bswap_32(value) : value;
+}
+
+// Network byte order fields of the packet itself
+static inline uint16_t read_net16(const char* Data)
+{
+   uint16_t value;
+
+   memcpy(&value, Data, sizeof(value));
+
+   return ntohs(value);
+}
+
+CPcapngIndex::CPcapngIndex()
+{
+   mPort = 0;
+   mSkipped = 0;
+}
+
+CPcapngIndex::~CPcapngIndex()
+{
+}
+
+bool CPcapngIndex::IsPcapng(const char* Filename)
+{
+   FILE*    file = fopen(Filename, "rb");
+   uint32_t type = 0;
+   bool     status;
+
+   if (!file)
+      return false;
+
+   // the section header block type reads the same in either byte order
+   status = (fread(&type, sizeof(type), 1, file) == 1 && type == PCAPNG_SHB);
+   fclose(file);
+
+   return status;
+}
+
+// Checks the block at Offset fits in the file, returning its type and length
+bool CPcapngIndex::ReadBlock(const char* Data, uint64_t Size, uint64_t Offset, bool Swapped, uint32_t& Type, uint32_t& Length) const
+{
+   if (Offset + 12 > Size)
+      return false;
+
+   Type = read32(Data + Offset, Swapped);
+   Length = read32(Data + Offset + 4, Swapped);
+
+   return Length >= 12 && (Length & 3) == 0 && Length <= Size - Offset;
+}
+
+// Adds the interface described by an interface description block
+bool CPcapngIndex::ReadInterface(const char* Block, uint32_t Length, TPcapngSection& Section) const
+{
+   TPcapngInterface interface;
+   uint32_t         option = 16;
+
+   if (Length < 20)
+      return false;
+
+   interface.link_type = read16(Block + 8, Section.swapped);
+   interface.ticks_per_second = 1000000;
+   interface.offset = 0;
+
+   // options run to the trailing block length
+   while (option + 4 <= Length - 4)
+   {
+      uint16_t code = read16(Block + option, Section.swapped);
+      uint16_t bytes = read16(Block + option + 2, Section.swapped);
+
+      if (code == 0 || option + 4 + bytes > Length - 4)
+         break;
+
+      if (code == 9 && bytes >= 1)
+      {
+         uint8_t resolution = Block[option + 4];
+
+         // a power of 10 or, with the top bit set, a power of 2
+         if (resolution & 0x80)
+            interface.ticks_per_second = ((resolution & 0x7f) < 64) ? 1ull << (resolution & 0x7f) : 0;
+         else
+         {
+            interface.ticks_per_second = 1;
+
+            for (int i = 0; i < resolution && i < 19; i++)
+               interface.ticks_per_second *= 10;
+         }
+      }
+      else if (code == 14 && bytes >= 8)
+      {
+         uint64_t offset;
+
+         memcpy(&offset, Block + option + 4, sizeof(offset));
+         interface.offset = (int64_t)(Section.swapped ? bswap_64(offset) : offset);
+      }
+
+      option += 4 + ((bytes + 3) & ~3u);
+   }
+
+   if (interface.ticks_per_second == 0)
+      interface.ticks_per_second = 1000000;
+
+   Section.interfaces.push_back(interface);
+
+   return true;
+}
+
+// Pulls the IPv4 UDP multicast datagram to mPort out of a packet block.
+// Fails for anything else, and for fragments and truncated datagrams.
+bool CPcapngIndex::ReadPacket(const char* Block, uint32_t Type, uint32_t Length, const TPcapngSection& Section, TPcapngPacket& Packet) const
+{
+   uint32_t interface_id;
+   uint32_t captured;
+   uint64_t ticks;
+
+   if (Length < 32)
+      return false;
+
+   if (Type == PCAPNG_EPB)
+      interface_id = read32(Block + 8, Section.swapped);
+   else
+      interface_id = read16(Block + 8, Section.swapped);
+
+   ticks = ((uint64_t)read32(Block + 12, Section.swapped) << 32) | read32(Block + 16, Section.swapped);
+   captured = read32(Block + 20, Section.swapped);
+
+   if (interface_id >= Section.interfaces.size() || captured > Length - 32)
+      return false;
+
+   const TPcapngInterface& interface = Section.interfaces[interface_id];
+   const char*             data = Block + 28;
+   uint32_t                link_bytes = 0;
+   uint16_t                protocol = 0x0800;
+
+   // find the IP header under the link layer
+   switch (interface.link_type)
+   {
+      case LINK_ETHERNET:
+         link_bytes = 14;
+
+         if (captured < link_bytes)
+            return false;
+
+         protocol = read_net16(data + 12);
+
+         // step over 802.1Q / 802.1ad tags
+         while ((protocol == 0x8100 || protocol == 0x88a8) && captured >= link_bytes + 4)
+         {
+            protocol = read_net16(data + link_bytes + 2);
+            link_bytes += 4;
+         }
+         break;
+
+      case LINK_LINUX_SLL:
+         link_bytes = 16;
+
+         if (captured < link_bytes)
+            return false;
+
+         protocol = read_net16(data + 14);
+         break;
+
+      case LINK_LINUX_SLL2:
+         link_bytes = 20;
+
+         if (captured < link_bytes)
+            return false;
+
+         protocol = read_net16(data);
+         break;
+
+      case LINK_NULL:
+      case LINK_LOOP:
+      {
+         uint32_t family;
+
+         link_bytes = 4;
+
+         if (captured < link_bytes)
+            return false;
+
+         // AF_INET, in whatever byte order the capturing host used
+         memcpy(&family, data, sizeof(family));
+         if (family != 2 && family != bswap_32(2u))
+            return false;
+         break;
+      }
+
+      case LINK_RAW:
+      case LINK_IPV4:
+         break;
+
+      default:
+         return false;
+   }
+
+   if (protocol != 0x0800 || captured < link_bytes + 20)
+      return false;
+
+   const char* ip = data + link_bytes;
+   uint32_t    ip_bytes = (ip[0] & 0x0f) * 4;
+   uint16_t    ip_length = read_net16(ip + 2);
+
+   if ((ip[0] & 0xf0) != 0x40 || ip[9] != 17 || ip_bytes < 20 || captured < link_bytes + ip_bytes + 8)
+      return false;
+
+   memcpy(&Packet.from_ip, ip + 12, sizeof(Packet.from_ip));
+   memcpy(&Packet.to_mcast_ip, ip + 16, sizeof(Packet.to_mcast_ip));
+
+   if (!IN_MULTICAST(ntohl(Packet.to_mcast_ip.s_addr)))
+      return false;
+
+   const char* udp = ip + ip_bytes;
+   uint16_t    udp_length = read_net16(udp + 4);
+
+   // fragments and datagrams cut short by the snap length cannot be replayed
+   if ((read_net16(ip + 6) & 0x3fff) != 0 || udp_length < 8 || ip_length < ip_bytes + udp_length ||
+       captured < link_bytes + ip_bytes + udp_length)
+      return false;
+
+   Packet.port = read_net16(udp + 2);
+
+   if (Packet.port != mPort)
+      return false;
+
+   Packet.payload = udp + 8;
+   Packet.bytes = udp_length - 8;
+   Packet.time = (double)(ticks / interface.ticks_per_second) + interface.offset +
+                 (double)(ticks % interface.ticks_per_second) / interface.ticks_per_second;
+
+   return true;
+}
+
+// Walks the capture once, finding the sections, interfaces and the streams
+// sent to Port
+bool CPcapngIndex::Load(const char* Filename, uint16_t Port)
+{
+   CMappedFile                   file;
+   std::map<uint64_t, uint32_t>  keys;
+   uint64_t                      offset = 0;
+   uint64_t                      skipped_udp = 0;
+
+   mFilename = Filename;
+   mPort = Port;
+   mSections.clear();
+   mStreams.clear();
+   mSkipped = 0;
+
+   if (!file.Open(Filename))
+      return false;
+
+   const char* data = file.GetData();
+   uint64_t    size = file.GetSize();
+
+   while (offset + 12 <= size)
+   {
+      bool     swapped = mSections.empty() ? false : mSections.back().swapped;
+      uint32_t type;
+      uint32_t length;
+
+      file.Prefetch(offset);
+
+      // a new section says which byte order it is in
+      if (read32(data + offset, false) == PCAPNG_SHB)
+      {
+         TPcapngSection section;
+
+         if (offset + 12 > size)
+            break;
+
+         section.offset = offset;
+         section.swapped = (read32(data + offset + 8, false) != PCAPNG_BYTE_ORDER);
+
+         if (section.swapped && read32(data + offset + 8, true) != PCAPNG_BYTE_ORDER)
+            break;
+
+         mSections.push_back(section);
+         swapped = section.swapped;
+      }
+
+      if (mSections.empty() || !ReadBlock(data, size, offset, swapped, type, length))
+         break;
+
+      if (type == PCAPNG_IDB)
+      {
+         ReadInterface(data + offset, length, mSections.back());
+      }
+      else if (type == PCAPNG_EPB || type == PCAPNG_PB)
+      {
+         TPcapngPacket packet;
+
+         if (ReadPacket(data + offset, type, length, mSections.back(), packet))
+         {
+            uint64_t key = ((uint64_t)packet.from_ip.s_addr << 32) | packet.to_mcast_ip.s_addr;
+            auto     stream = keys.find(key);
+
+            if (stream == keys.end())
+            {
+               TPcapngStream entry;
+
+               entry.stream_id = mStreams.size();
+               entry.from_ip = packet.from_ip;
+               entry.to_mcast_ip = packet.to_mcast_ip;
+               entry.num_packets = 0;
+               entry.index.Reset(offset);
+
+               mStreams.push_back(entry);
+               stream = keys.emplace(key, entry.stream_id).first;
+            }
+
+            TPcapngStream& entry = mStreams[stream->second];
+
+            entry.index.Add(packet.time, offset);
+            entry.offsets.push_back(offset);
+            entry.num_packets++;
+         }
+         else
+         {
+            skipped_udp++;
+         }
+      }
+
+      offset += length;
+   }
+
+   if (offset < size)
+      printf("Warning: %s is damaged or truncated after %lu bytes\n", Filename, offset);
+
+   mSkipped = skipped_udp;
+
+   return !mSections.empty();
+}
+
+// Reads the packet in the block at Offset, one of the stream offsets found
+// by Load.  The section of the block is looked up by where it is.
+bool CPcapngIndex::ReadPacketAt(const char* Data, uint64_t Size, uint64_t Offset, TPcapngPacket& Packet) const
+{
+   auto section = std::upper_bound(mSections.begin(), mSections.end(), Offset,
+      [](uint64_t Offset, const TPcapngSection& Section) { return Offset < Section.offset; });
+   uint32_t type;
+   uint32_t length;
+
+   if (section == mSections.begin())
+      return false;
+
+   section--;
+
+   if (!ReadBlock(Data, Size, Offset, section->swapped, type, length))
+      return false;
+
+   return (type == PCAPNG_EPB || type == PCAPNG_PB) && ReadPacket(Data + Offset, type, length, *section, Packet);
+}
+
+CPcapngStreamReader::CPcapngStreamReader()
+{
+   mIndex = nullptr;
+   mStream = nullptr;
+   mNext = 0;
+}
+
+CPcapngStreamReader::~CPcapngStreamReader()
+{
+}
+
+bool CPcapngStreamReader::Open(const CPcapngIndex& Index, uint32_t StreamId)
+{
+   if (StreamId >= Index.GetStreams().size() || !mFile.Open(Index.GetFilename().c_str()))
+      return false;
+
+   mIndex = &Index;
+   mStream = &Index.GetStreams()[StreamId];
+
+   return Rewind();
+}
+
+bool CPcapngStreamReader::Rewind()
+{
+   if (!mStream)
+      return false;
+
+   mNext = 0;
+
+   if (!mStream->offsets.empty())
+      mFile.Prefetch(mStream->offsets[0]);
+
+   return true;
+}
+
+// Next packet of this stream, Start is its position in the stream offsets
+bool CPcapngStreamReader::NextPacket(TPcapngPacket& Packet, size_t& Start)
+{
+   const std::vector<uint64_t>& offsets = mStream->offsets;
+
+   if (mNext >= offsets.size())
+      return false;
+
+   Start = mNext;
+
+   if (!mIndex->ReadPacketAt(mFile.GetData(), mFile.GetSize(), offsets[mNext], Packet))
+   {
+      mNext = offsets.size();
+      return false;
+   }
+
+   mNext++;
+
+   if (mNext < offsets.size())
+      mFile.Prefetch(offsets[mNext]);
+
+   return true;
+}
+
+bool CPcapngStreamReader::Seek(double Time)
+{
+   TPcapngPacket packet;
+   size_t        start;
+
+   if (!mStream)
+      return false;
+
+   // jump to the indexed packet before Time, then skip forward to it
+   uint64_t offset = mStream->index.Find(Time);
+
+   mNext = std::lower_bound(mStream->offsets.begin(), mStream->offsets.end(), offset) - mStream->offsets.begin();
+
+   while (NextPacket(packet, start))
+   {
+      if (packet.time >= Time)
+      {
+         mNext = start;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool CPcapngStreamReader::Next(TPlaybackRecord& Record)
+{
+   TPcapngPacket packet;
+   size_t        start;
+
+   if (!mStream || !NextPacket(packet, start))
+      return false;
+
+   Record.time      = packet.time;
+   Record.real_time = packet.time;
+   Record.bytes     = packet.bytes;
+   Record.payload   = packet.payload;
+
+   return true;
+}
+
+bool CPcapngStreamReader::GetTimeRange(double& First, double& Last) const
+{
+   if (!mStream || mStream->index.IsEmpty())
+      return false;
+
+   First = mStream->index.GetFirstTime();
+   Last = mStream->index.GetLastTime();
+
+   return true;
+}
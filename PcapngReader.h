@@ -0,0 +1,144 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Pcapng Reader
+//  Class:      C++ Header
+//  Filename:   PcapngReader.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPcapngIndex
+//! \brief The UDP multicast streams in a pcapng capture
+//!
+//! \class CPcapngStreamReader
+//! \brief Plays one stream straight out of a pcapng capture
+//!
+//! CPcapngIndex walks the capture once through a mapping and notes, for
+//! every section, the link type and timestamp resolution of each interface,
+//! and for every (source, group) pair of IPv4 UDP multicast datagrams to
+//! the port it is loaded for the offset of each of its packet blocks and a
+//! sparse CTimeIndex over them.  Datagrams to other ports (mDNS, SSDP and
+//! the like) are not recorded traffic and are skipped.
+//!
+//! Each CPcapngStreamReader maps the file itself and steps through the
+//! offsets of its own stream, so the other streams' packets are never read
+//! again after Load.  The offsets take 8 bytes a packet.  Payloads are
+//! returned in place, nothing else is loaded into memory.
+//!
+//! Enhanced and obsolete packet blocks are read, on Ethernet (with VLAN
+//! tags), Linux cooked (v1 and v2), raw IP and BSD loopback links.  Simple
+//! packet blocks have no timestamp and are skipped, as are fragmented and
+//! truncated datagrams.  Times are the capture timestamps (UTC), so they
+//! are also the real times of the records.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include "RecordReader.h"
+#include "TimeIndex.h"
+#include "MappedFile.h"
+
+struct TPcapngInterface
+{
+   uint16_t link_type;
+   uint64_t ticks_per_second; // from if_tsresol, default microseconds
+   int64_t  offset;           // if_tsoffset, seconds
+};
+
+struct TPcapngSection
+{
+   uint64_t                      offset;  // of its section header block
+   bool                          swapped; // written in the other byte order
+   std::vector<TPcapngInterface> interfaces;
+};
+
+struct TPcapngPacket
+{
+   double         time;
+   struct in_addr from_ip;
+   struct in_addr to_mcast_ip;
+   uint16_t       port;
+   const char*    payload;
+   uint32_t       bytes;
+};
+
+struct TPcapngStream
+{
+   uint32_t       stream_id;
+   struct in_addr from_ip;
+   struct in_addr to_mcast_ip;
+   uint64_t              num_packets;
+   std::vector<uint64_t> offsets; // of the block of each packet, in file order
+   CTimeIndex            index;   // data offset is its first packet
+};
+
+class CPcapngIndex
+{
+public:
+   CPcapngIndex();
+   ~CPcapngIndex();
+
+   static bool IsPcapng(const char* Filename);
+
+   bool Load(const char* Filename, uint16_t Port);
+
+   bool ReadPacketAt(const char* Data, uint64_t Size, uint64_t Offset, TPcapngPacket& Packet) const;
+
+   const std::string&                GetFilename() const { return mFilename; }
+   const std::vector<TPcapngStream>& GetStreams() const { return mStreams; }
+   uint64_t                          GetSkipped() const { return mSkipped; }
+
+private:
+   bool ReadBlock(const char* Data, uint64_t Size, uint64_t Offset, bool Swapped, uint32_t& Type, uint32_t& Length) const;
+   bool ReadPacket(const char* Block, uint32_t Type, uint32_t Length, const TPcapngSection& Section, TPcapngPacket& Packet) const;
+   bool ReadInterface(const char* Block, uint32_t Length, TPcapngSection& Section) const;
+
+   std::string                 mFilename;
+   std::vector<TPcapngSection> mSections;
+   std::vector<TPcapngStream>  mStreams;
+   uint16_t                    mPort;    // destination port of the datagrams to play
+   uint64_t                    mSkipped; // packets that are not whole UDP multicast datagrams to mPort
+};
+
+class CPcapngStreamReader : public CStreamReader
+{
+public:
+   CPcapngStreamReader();
+   ~CPcapngStreamReader() override;
+
+   bool Open(const CPcapngIndex& Index, uint32_t StreamId);
+
+   bool Rewind() override;
+   bool Seek(double Time) override;
+   bool Next(TPlaybackRecord& Record) override;
+   bool GetTimeRange(double& First, double& Last) const override;
+
+private:
+   bool NextPacket(TPcapngPacket& Packet, size_t& Start);
+
+   const CPcapngIndex*  mIndex;
+   const TPcapngStream* mStream;
+   CMappedFile          mFile;
+   size_t               mNext;   // in the stream's offsets, of the next packet
+};
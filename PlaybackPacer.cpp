@@ -0,0 +1,177 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Pacer
+//  Class:      C++ Source
+//  Filename:   PlaybackPacer.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "SimTimer.h"
+#include "PlaybackPacer.h"
+
+CPlaybackPacer::CPlaybackPacer()
+{
+   mMode = PACE_HYBRID;
+   ResetStats();
+}
+
+CPlaybackPacer::~CPlaybackPacer()
+{
+}
+
+bool CPlaybackPacer::ParseMode(const char* Name, ePaceMode& Mode)
+{
+   if (strcmp(Name, "sleep") == 0)
+      Mode = PACE_SLEEP;
+   else if (strcmp(Name, "hybrid") == 0)
+      Mode = PACE_HYBRID;
+   else if (strcmp(Name, "spin") == 0)
+      Mode = PACE_SPIN;
+   else
+      return false;
+
+   return true;
+}
+
+const char* CPlaybackPacer::GetModeName(ePaceMode Mode)
+{
+   switch (Mode)
+   {
+      case PACE_SLEEP:  return "sleep";
+      case PACE_HYBRID: return "hybrid";
+      case PACE_SPIN:   return "spin";
+   }
+
+   return "unknown";
+}
+
+// Returns true once Deadline has passed.  Returns false early if the sleep
+// was interrupted by a signal or ran for MAX_SLEEP, or the spin ran for
+// MAX_SPIN, so the caller can check whether to stop before waiting again.
+bool CPlaybackPacer::WaitUntil(double Deadline)
+{
+   double now = CSimTimer::GetCurrentTime();
+
+   if (now >= Deadline)
+      return true;
+
+   if (mMode != PACE_SPIN)
+   {
+      double          wake = (mMode == PACE_HYBRID) ? Deadline - SPIN_MARGIN : Deadline;
+      struct timespec ts;
+
+      if (wake > now)
+      {
+         bool capped = (wake > now + MAX_SLEEP);
+
+         if (capped)
+            wake = now + MAX_SLEEP;
+
+         ts.tv_sec = (time_t)wake;
+         ts.tv_nsec = (long)((wake - ts.tv_sec) * 1000000000.0);
+
+         if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 || capped)
+            return false;
+      }
+
+      if (mMode == PACE_SLEEP)
+         return true;
+
+      now = CSimTimer::GetCurrentTime();
+   }
+
+   double give_up = now + MAX_SPIN;
+
+   while (now < Deadline)
+   {
+      if (now >= give_up)
+         return false;
+
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      now = CSimTimer::GetCurrentTime();
+   }
+
+   return true;
+}
+
+void CPlaybackPacer::AddSample(double Deadline, double Actual)
+{
+   double error = Actual - Deadline;
+   double limit = 0.000001;
+   int    bin = 0;
+
+   if (error < 0.0)
+      error = 0.0;
+
+   while (bin < NUM_BINS - 1 && error >= limit)
+   {
+      limit *= 10.0;
+      bin++;
+   }
+
+   mBins[bin]++;
+   mSamples++;
+   mTotalError += error;
+
+   if (error > mMaxError)
+      mMaxError = error;
+}
+
+void CPlaybackPacer::Merge(const CPlaybackPacer& Other)
+{
+   mSamples += Other.mSamples;
+   mTotalError += Other.mTotalError;
+
+   if (Other.mMaxError > mMaxError)
+      mMaxError = Other.mMaxError;
+
+   for (int i = 0; i < NUM_BINS; i++)
+      mBins[i] += Other.mBins[i];
+}
+
+void CPlaybackPacer::ResetStats()
+{
+   mSamples = 0;
+   mTotalError = 0.0;
+   mMaxError = 0.0;
+   memset(mBins, 0, sizeof(mBins));
+}
+
+void CPlaybackPacer::PrintStats() const
+{
+   static const char* labels[NUM_BINS] = { "<1us", "<10us", "<100us", "<1ms", "<10ms", ">=10ms" };
+
+   if (mSamples == 0)
+      return;
+
+   printf("Timing error (%s): %lu packets, mean %.1f us, max %.1f us\n", GetModeName(mMode), mSamples, GetMeanError() * 1e6, mMaxError * 1e6);
+
+   for (int i = 0; i < NUM_BINS; i++)
+      printf("  %-7s %5.1f%%\n", labels[i], 100.0 * mBins[i] / mSamples);
+}
@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Pacer
+//  Class:      C++ Header
+//  Filename:   PlaybackPacer.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPlaybackPacer
+//! \brief Waits for absolute playback deadlines and measures how late sends are
+//!
+//! Deadlines are CLOCK_MONOTONIC times (CSimTimer::GetCurrentTime).
+//!  - PACE_SLEEP  sleeps with clock_nanosleep(TIMER_ABSTIME) to the deadline
+//!  - PACE_HYBRID sleeps to SPIN_MARGIN before the deadline and spins the rest
+//!  - PACE_SPIN   spins the whole way, using a core but giving the best timing
+//!
+//! AddSample records how late each packet went out compared to its deadline,
+//! PrintStats reports the mean, maximum and a histogram by decade.  Each
+//! sender thread has its own pacer, Merge combines their statistics.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+
+enum ePaceMode
+{
+   PACE_SLEEP,
+   PACE_HYBRID,
+   PACE_SPIN
+};
+
+class CPlaybackPacer
+{
+public:
+   static constexpr double SPIN_MARGIN = 0.0002; // hybrid wakes this early and spins
+   static constexpr double MAX_SPIN    = 0.01;   // longest WaitUntil spins before returning
+   static constexpr double MAX_SLEEP   = 0.1;    // longest WaitUntil sleeps before returning
+   static constexpr int    NUM_BINS    = 6;      // < 1 us, 10 us, 100 us, 1 ms, 10 ms, more
+
+   CPlaybackPacer();
+   ~CPlaybackPacer();
+
+   static bool        ParseMode(const char* Name, ePaceMode& Mode);
+   static const char* GetModeName(ePaceMode Mode);
+
+   void      SetMode(ePaceMode Mode) { mMode = Mode; }
+   ePaceMode GetMode() const { return mMode; }
+
+   bool WaitUntil(double Deadline);
+
+   void AddSample(double Deadline, double Actual);
+   void Merge(const CPlaybackPacer& Other);
+   void ResetStats();
+   void PrintStats() const;
+
+   uint64_t GetSamples() const { return mSamples; }
+   double   GetMeanError() const { return mSamples ? mTotalError / mSamples : 0.0; }
+   double   GetMaxError() const { return mMaxError; }
+
+private:
+   ePaceMode mMode;
+   uint64_t  mSamples;
+   double    mTotalError;
+   double    mMaxError;
+   uint64_t  mBins[NUM_BINS];
+};
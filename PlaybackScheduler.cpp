@@ -0,0 +1,141 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Scheduler
+//  Class:      C++ Source
+//  Filename:   PlaybackScheduler.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+#include "PlaybackScheduler.h"
+
+CPlaybackScheduler::CPlaybackScheduler()
+{
+   mWindowStart = -HUGE_VAL;
+   mWindowEnd = HUGE_VAL;
+   mStartTime = 0.0;
+}
+
+CPlaybackScheduler::~CPlaybackScheduler()
+{
+}
+
+uint32_t CPlaybackScheduler::AddStream(CStreamReader* Reader)
+{
+   mReaders.push_back(Reader);
+   mRecords.push_back({});
+
+   return mReaders.size() - 1;
+}
+
+// Time of the first and last record over all streams
+bool CPlaybackScheduler::GetTimeRange(double& First, double& Last) const
+{
+   bool status = false;
+
+   First = HUGE_VAL;
+   Last = -HUGE_VAL;
+
+   for (size_t i = 0; i < mReaders.size(); i++)
+   {
+      double first;
+      double last;
+
+      if (mReaders[i]->GetTimeRange(first, last))
+      {
+         First = std::min(First, first);
+         Last = std::max(Last, last);
+         status = true;
+      }
+   }
+
+   return status;
+}
+
+void CPlaybackScheduler::SetWindow(double Start, double End)
+{
+   mWindowStart = Start;
+   mWindowEnd = End;
+}
+
+// Positions every stream at the start of the window and queues its first
+// record.  Returns false if there is nothing to play.
+bool CPlaybackScheduler::Start()
+{
+   mHeap.clear();
+
+   for (uint32_t i = 0; i < mReaders.size(); i++)
+   {
+      bool status = (mWindowStart == -HUGE_VAL) ? mReaders[i]->Rewind() : mReaders[i]->Seek(mWindowStart);
+
+      if (status && Advance(i))
+         mHeap.push_back({ mRecords[i].time, i });
+   }
+
+   std::make_heap(mHeap.begin(), mHeap.end(), TLater());
+
+   mStartTime = mHeap.empty() ? 0.0 : mHeap.front().time;
+
+   return !mHeap.empty();
+}
+
+// Reads the next record of a stream, false at the end of the stream or window
+bool CPlaybackScheduler::Advance(uint32_t Stream)
+{
+   return mReaders[Stream]->Next(mRecords[Stream]) && mRecords[Stream].time <= mWindowEnd;
+}
+
+double CPlaybackScheduler::GetNextTime() const
+{
+   return mHeap.empty() ? HUGE_VAL : mHeap.front().time;
+}
+
+// Hands out the earliest queued packet if it is due by Time, and queues the
+// next record of its stream.  The payload points into the stream's reader.
+bool CPlaybackScheduler::PopDue(double Time, TScheduledPacket& Packet)
+{
+   if (mHeap.empty() || mHeap.front().time > Time)
+      return false;
+
+   std::pop_heap(mHeap.begin(), mHeap.end(), TLater());
+
+   uint32_t stream = mHeap.back().stream;
+
+   Packet.stream = stream;
+   Packet.record = mRecords[stream];
+   Packet.last = !Advance(stream);
+
+   if (Packet.last)
+   {
+      mHeap.pop_back();
+   }
+   else
+   {
+      mHeap.back().time = mRecords[stream].time;
+      std::push_heap(mHeap.begin(), mHeap.end(), TLater());
+   }
+
+   return true;
+}
@@ -0,0 +1,95 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Scheduler
+//  Class:      C++ Header
+//  Filename:   PlaybackScheduler.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPlaybackScheduler
+//! \brief Merges the recorded streams into one time ordered packet sequence
+//!
+//! Keeps the next record of every stream in a min-heap keyed on its recorded
+//! time, so finding what is due costs O(log streams) per packet instead of a
+//! scan of every stream.  PopDue hands out every packet up to a time in global
+//! time order (ties go to the lower stream number).
+//!
+//! Streams are played between the window set with SetWindow; Start seeks every
+//! stream to the window start and can be called again to loop.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RecordReader.h"
+
+struct TScheduledPacket
+{
+   uint32_t        stream; // as returned by AddStream
+   bool            last;   // no more packets on this stream
+   TPlaybackRecord record;
+};
+
+class CPlaybackScheduler
+{
+public:
+   CPlaybackScheduler();
+   ~CPlaybackScheduler();
+
+   uint32_t AddStream(CStreamReader* Reader);
+
+   bool GetTimeRange(double& First, double& Last) const;
+   void SetWindow(double Start, double End);
+
+   bool Start();
+   bool PopDue(double Time, TScheduledPacket& Packet);
+
+   bool   IsDone() const { return mHeap.empty(); }
+   double GetNextTime() const;
+   double GetStartTime() const { return mStartTime; }
+   size_t GetNumStreams() const { return mReaders.size(); }
+
+private:
+   struct TEntry
+   {
+      double   time;
+      uint32_t stream;
+   };
+
+   // orders the heap so the earliest entry is on top
+   struct TLater
+   {
+      bool operator()(const TEntry& A, const TEntry& B) const
+      {
+         return A.time > B.time || (A.time == B.time && A.stream > B.stream);
+      }
+   };
+
+   bool Advance(uint32_t Stream);
+
+   std::vector<CStreamReader*>   mReaders; // not owned
+   std::vector<TPlaybackRecord>  mRecords; // next record of each stream
+   std::vector<TEntry>           mHeap;
+   double                        mWindowStart;
+   double                        mWindowEnd;
+   double                        mStartTime;
+};
@@ -0,0 +1,87 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Timeline
+//  Class:      C++ Source
+//  Filename:   PlaybackTimeline.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <chrono>
+#include "SimTimer.h"
+#include "PlaybackTimeline.h"
+
+CPlaybackTimeline::CPlaybackTimeline(int NumWorkers, const std::atomic<bool>& Running)
+   : mNumWorkers(NumWorkers), mRunning(Running)
+{
+   mArrived = 0;
+   mGeneration = 0;
+   mEarliest = HUGE_VAL;
+   mStartTime = HUGE_VAL;
+   mRealStartTime = 0.0;
+}
+
+CPlaybackTimeline::~CPlaybackTimeline()
+{
+}
+
+// Waits for every sender thread.  FirstTime is the recorded time of the
+// thread's first packet (HUGE_VAL if it has none).  Returns the shared start
+// times, or false if no thread has anything to play or playback was stopped.
+bool CPlaybackTimeline::Sync(double FirstTime, double& StartTime, double& RealStartTime)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   uint64_t                     generation = mGeneration;
+
+   if (FirstTime < mEarliest)
+      mEarliest = FirstTime;
+
+   if (++mArrived == mNumWorkers)
+   {
+      mStartTime = mEarliest;
+      mRealStartTime = CSimTimer::GetCurrentTime();
+
+      mArrived = 0;
+      mEarliest = HUGE_VAL;
+      mGeneration++;
+
+      mCondition.notify_all();
+   }
+   else
+   {
+      // threads that stop on SIGINT never arrive, so keep checking
+      while (mGeneration == generation)
+      {
+         if (!mRunning)
+            return false;
+
+         mCondition.wait_for(lock, std::chrono::milliseconds(100));
+      }
+   }
+
+   StartTime = mStartTime;
+   RealStartTime = mRealStartTime;
+
+   return mStartTime != HUGE_VAL && mRunning;
+}
@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Playback Timeline
+//  Class:      C++ Header
+//  Filename:   PlaybackTimeline.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CPlaybackTimeline
+//! \brief Keeps the playback sender threads on one shared timeline
+//!
+//! Every sender thread calls Sync with the time of its first packet before it
+//! starts, and again each time it loops.  The last thread to arrive picks the
+//! earliest of those times as the recorded start time, stamps the wall clock
+//! start, and releases all of them, so packets on different threads are paced
+//! against the same clock and loops stay in step.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+class CPlaybackTimeline
+{
+public:
+   CPlaybackTimeline(int NumWorkers, const std::atomic<bool>& Running);
+   ~CPlaybackTimeline();
+
+   bool Sync(double FirstTime, double& StartTime, double& RealStartTime);
+
+private:
+   const int                mNumWorkers;
+   const std::atomic<bool>& mRunning;
+   std::mutex               mMutex;
+   std::condition_variable  mCondition;
+   int                      mArrived;
+   uint64_t                 mGeneration;
+   double                   mEarliest;      // earliest first time of this generation so far
+   double                   mStartTime;
+   double                   mRealStartTime;
+};
@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Rate Limiter
+//  Class:      C++ Source
+//  Filename:   RateLimiter.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include "RateLimiter.h"
+
+CRateLimiter::CRateLimiter()
+{
+   mPacketsPerSec = 0.0;
+   mBitsPerSec = 0.0;
+   mNextFree = 0.0;
+}
+
+CRateLimiter::~CRateLimiter()
+{
+}
+
+void CRateLimiter::SetRate(double PacketsPerSec, double BitsPerSec)
+{
+   mPacketsPerSec = PacketsPerSec;
+   mBitsPerSec = BitsPerSec;
+   mNextFree = 0.0;
+}
+
+// Takes the credit for one packet of Bytes and returns the earliest time it
+// may be sent, Now if it can go straight away
+double CRateLimiter::Reserve(int Bytes, double Now)
+{
+   double cost = 0.0;
+   double send_time;
+
+   if (!IsLimited())
+      return Now;
+
+   if (mPacketsPerSec > 0.0)
+      cost = 1.0 / mPacketsPerSec;
+
+   if (mBitsPerSec > 0.0 && Bytes * 8.0 / mBitsPerSec > cost)
+      cost = Bytes * 8.0 / mBitsPerSec;
+
+   // credit left over from an idle period only carries a short burst
+   if (mNextFree < Now - BURST)
+      mNextFree = Now - BURST;
+
+   send_time = (mNextFree > Now) ? mNextFree : Now;
+   mNextFree += cost;
+
+   return send_time;
+}
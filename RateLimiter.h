@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Rate Limiter
+//  Class:      C++ Header
+//  Filename:   RateLimiter.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CRateLimiter
+//! \brief Token bucket that caps playback at a packet and/or bit rate
+//!
+//! Each packet costs 1/pps or bits/bps seconds, whichever is longer.  Reserve
+//! returns the time the packet may go out; up to BURST seconds of unused
+//! credit can be spent at once so a capped stream still goes out in batches.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+class CRateLimiter
+{
+public:
+   static constexpr double BURST = 0.001;
+
+   CRateLimiter();
+   ~CRateLimiter();
+
+   void SetRate(double PacketsPerSec, double BitsPerSec);
+   bool IsLimited() const { return mPacketsPerSec > 0.0 || mBitsPerSec > 0.0; }
+
+   double Reserve(int Bytes, double Now);
+
+private:
+   double mPacketsPerSec; // 0 for no limit
+   double mBitsPerSec;    // 0 for no limit
+   double mNextFree;      // time the credit runs out to
+};
@@ -0,0 +1,172 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Record File
+//  Class:      C++ Header
+//  Filename:   RecordFile.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              Defines the on-disk layout of the file_<ip>_<mc>.bin recording
+//              files.
+//
+//              Version 1 files have no file header and are a sequence of
+//                 double time; uint64_t bytes; char payload[bytes];
+//              where time is the CLOCK_MONOTONIC time the recorder stored the
+//              packet.
+//
+//              Version 2 files start with a TRecordFileHeader followed by a
+//              sequence of TRecordHeader + payload.  Both a monotonic and a
+//              realtime stamp are kept so recordings made on different hosts
+//              can be lined up against each other.
+//
+//              Version 3 files are recorded with payload deduplication or
+//              delta encoding.  They are version 2 files that may also hold
+//                 reference records, whose header has RECORD_REFERENCE set in
+//                 bytes and is followed by a TRecordReference giving the file
+//                 offset of an earlier, identical payload instead of the
+//                 payload, and
+//                 delta records, whose header has RECORD_DELTA set in bytes
+//                 and is followed by that many bytes of CDeltaCodec encoding
+//                 against the previous payload of the file.  The payload is
+//                 as long as the previous one.
+//              The time index only points at records that decode on their own.
+//
+//              A session container (.urec) holds every stream of a recording
+//              in one append-only file:
+//                 TRecordFileHeader (CONTAINER_MAGIC)
+//                 chunks, each a TChunkHeader followed by its body
+//                 footer: TContainerStream[] TChunkIndexEntry[] TContainerTrailer
+//              CHUNK_STREAM chunks define a stream ID (body is a
+//              TContainerStream), CHUNK_DATA chunks hold version 2 records
+//              (TRecordHeader + payload) of a single stream.  The footer is a
+//              copy of what the chunks already say, so a container that was
+//              never closed can still be read by walking the chunks.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+static constexpr char     RECORD_FILE_MAGIC[8]   = { 'U', 'D', 'P', 'R', 'E', 'C', 0, 0 };
+static constexpr uint32_t RECORD_FILE_VERSION    = 2;
+static constexpr uint32_t RECORD_FILE_VERSION_V1 = 1;
+static constexpr uint32_t RECORD_FILE_VERSION_V3 = 3;           // with reference and delta records
+static constexpr uint64_t RECORD_REFERENCE       = 1ull << 63; // in TRecordHeader::bytes
+static constexpr uint64_t RECORD_DELTA           = 1ull << 62;
+
+struct TRecordFileHeader
+{
+   char     magic[8];    // RECORD_FILE_MAGIC
+   uint32_t version;     // RECORD_FILE_VERSION
+   uint32_t header_size; // offset of the first record
+};
+
+static constexpr char     CONTAINER_MAGIC[8]         = { 'U', 'D', 'P', 'C', 'O', 'N', 0, 0 };
+static constexpr char     CONTAINER_TRAILER_MAGIC[8] = { 'U', 'D', 'P', 'I', 'D', 'X', 0, 0 };
+static constexpr uint32_t CONTAINER_VERSION          = 1;
+
+enum eChunkType {CHUNK_STREAM = 1, CHUNK_DATA = 2};
+
+struct TRecordHeader
+{
+   double   time;      // receive time, CLOCK_MONOTONIC seconds
+   double   real_time; // receive time, CLOCK_REALTIME seconds since the epoch
+   uint64_t bytes;     // payload bytes following this header
+};
+
+struct TRecordReference
+{
+   uint64_t offset;    // file offset of the payload
+};
+
+struct TChunkHeader
+{
+   uint32_t type;        // eChunkType
+   uint32_t stream_id;
+   uint32_t num_records; // records in a CHUNK_DATA chunk
+   uint32_t bytes;       // body bytes following this header
+   double   first_time;  // monotonic time of the first record
+   double   last_time;   // monotonic time of the last record
+};
+
+struct TContainerStream
+{
+   uint32_t stream_id;
+   uint32_t from_ip;     // network byte order
+   uint32_t to_mcast_ip; // network byte order
+   uint32_t reserved;
+};
+
+struct TChunkIndexEntry
+{
+   uint64_t offset;      // file offset of the TChunkHeader
+   uint32_t stream_id;
+   uint32_t num_records;
+   double   first_time;
+   double   last_time;
+};
+
+struct TContainerTrailer
+{
+   uint64_t streams_offset;
+   uint64_t chunks_offset;
+   uint32_t num_streams;
+   uint32_t num_chunks;
+   char     magic[8];    // CONTAINER_TRAILER_MAGIC
+};
+
+inline void InitRecordFileHeader(TRecordFileHeader& Header, uint32_t Version = RECORD_FILE_VERSION)
+{
+   memcpy(Header.magic, RECORD_FILE_MAGIC, sizeof(Header.magic));
+   Header.version     = Version;
+   Header.header_size = sizeof(TRecordFileHeader);
+}
+
+// Payload bytes of a record that holds or references them, or the encoded
+// bytes of a delta record
+inline uint64_t GetRecordBytes(const TRecordHeader& Header)
+{
+   return Header.bytes & ~(RECORD_REFERENCE | RECORD_DELTA);
+}
+
+// Bytes following a record header on disk
+inline uint64_t GetRecordBodySize(const TRecordHeader& Header)
+{
+   return (Header.bytes & RECORD_REFERENCE) ? sizeof(TRecordReference) : GetRecordBytes(Header);
+}
+
+// A record that decodes without the ones before it
+inline bool IsRecordSeekable(const TRecordHeader& Header)
+{
+   return !(Header.bytes & RECORD_DELTA);
+}
+
+// Returns the file version described by the first bytes of a .bin file.
+// Version 1 files have no header, so anything without the magic is treated
+// as version 1.
+inline uint32_t GetRecordFileVersion(const TRecordFileHeader& Header)
+{
+   if (memcmp(Header.magic, RECORD_FILE_MAGIC, sizeof(Header.magic)) != 0)
+      return RECORD_FILE_VERSION_V1;
+
+   return Header.version;
+}
@@ -0,0 +1,334 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Record Reader
+//  Class:      C++ Source
+//  Filename:   RecordReader.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "RecordReader.h"
+#include "DeltaCodec.h"
+
+CBinFileReader::CBinFileReader()
+{
+   mVersion = RECORD_FILE_VERSION_V1;
+   mDataOffset = 0;
+   mOffset = 0;
+   mPrevious = nullptr;
+   mPreviousBytes = 0;
+   mSlot = 0;
+}
+
+CBinFileReader::~CBinFileReader()
+{
+}
+
+bool CBinFileReader::Open(const char* Filename)
+{
+   TRecordFileHeader header = {};
+
+   if (!mFile.Open(Filename))
+      return false;
+
+   if (mFile.GetSize() >= sizeof(header))
+      memcpy(&header, mFile.GetData(), sizeof(header));
+
+   // version 1 files have no header, the first record starts at 0
+   mVersion = GetRecordFileVersion(header);
+   mDataOffset = (mVersion == RECORD_FILE_VERSION_V1) ? 0 : header.header_size;
+
+   if (!mIndex.LoadOrBuild(Filename))
+      printf("Warning: no time index for %s\n", Filename);
+
+   return Rewind();
+}
+
+bool CBinFileReader::Rewind()
+{
+   mOffset = mDataOffset;
+   mPrevious = nullptr;
+   mFile.Prefetch(mOffset);
+
+   return mOffset <= mFile.GetSize();
+}
+
+// Reads the record at Offset, version 1 headers have no real time.  Size is
+// its length in the file and Header.bytes its payload bytes, which are at
+// PayloadOffset (further back in the file for a reference record).  A delta
+// record keeps RECORD_DELTA in Header.bytes, with its encoded bytes at
+// PayloadOffset.  Fails if the record or its payload runs past the end of the
+// file.
+bool CBinFileReader::ReadHeader(uint64_t Offset, TRecordHeader& Header, uint64_t& Size, uint64_t& PayloadOffset) const
+{
+   const char* data = mFile.GetData() + Offset;
+   uint64_t    header_size;
+
+   if (mVersion == RECORD_FILE_VERSION_V1)
+   {
+      header_size = sizeof(Header.time) + sizeof(Header.bytes);
+
+      if (Offset + header_size > mFile.GetSize())
+         return false;
+
+      memcpy(&Header.time, data, sizeof(Header.time));
+      memcpy(&Header.bytes, data + sizeof(Header.time), sizeof(Header.bytes));
+      Header.real_time = 0.0;
+   }
+   else
+   {
+      header_size = sizeof(Header);
+
+      if (Offset + header_size > mFile.GetSize())
+         return false;
+
+      memcpy(&Header, data, sizeof(Header));
+   }
+
+   if (mVersion >= RECORD_FILE_VERSION_V3 && (Header.bytes & RECORD_REFERENCE))
+   {
+      TRecordReference reference;
+
+      if (sizeof(reference) > mFile.GetSize() - Offset - header_size)
+         return false;
+
+      memcpy(&reference, data + header_size, sizeof(reference));
+
+      Header.bytes = GetRecordBytes(Header);
+      Size = header_size + sizeof(reference);
+      PayloadOffset = reference.offset;
+
+      // references only ever point back to a payload written before them
+      return PayloadOffset >= mDataOffset && PayloadOffset < Offset && Header.bytes <= Offset - PayloadOffset;
+   }
+
+   Size = header_size + GetRecordBodySize(Header);
+   PayloadOffset = Offset + header_size;
+
+   return GetRecordBodySize(Header) <= mFile.GetSize() - Offset - header_size;
+}
+
+bool CBinFileReader::Seek(double Time)
+{
+   TRecordHeader   header;
+   TPlaybackRecord record;
+   uint64_t        size;
+   uint64_t        payload;
+
+   // jump to the indexed record before Time, which decodes on its own, then
+   // read forward to it so the delta records on the way are decoded
+   mOffset = mIndex.Find(Time);
+   mPrevious = nullptr;
+
+   while (ReadHeader(mOffset, header, size, payload))
+   {
+      if (header.time >= Time)
+      {
+         mFile.Prefetch(mOffset);
+         return true;
+      }
+
+      if (!Next(record))
+         return false;
+   }
+
+   return false;
+}
+
+bool CBinFileReader::Next(TPlaybackRecord& Record)
+{
+   TRecordHeader header;
+   uint64_t      size;
+   uint64_t      payload;
+
+   if (!ReadHeader(mOffset, header, size, payload))
+      return false;
+
+   Record.time      = header.time;
+   Record.real_time = header.real_time;
+
+   if (mVersion >= RECORD_FILE_VERSION_V3 && (header.bytes & RECORD_DELTA))
+   {
+      // decoded into the oldest slot, the previous payload is in another
+      std::vector<char>& slot = mDecoded[mSlot++ % DECODE_DEPTH];
+
+      if (!mPrevious)
+         return false;
+
+      if (slot.size() < mPreviousBytes)
+         slot.resize(mPreviousBytes);
+
+      if (!CDeltaCodec::Decode(mPrevious, mFile.GetData() + payload, GetRecordBytes(header), slot.data(), mPreviousBytes))
+         return false;
+
+      Record.bytes   = mPreviousBytes;
+      Record.payload = slot.data();
+   }
+   else
+   {
+      Record.bytes   = header.bytes;
+      Record.payload = mFile.GetData() + payload;
+   }
+
+   mPrevious = Record.payload;
+   mPreviousBytes = Record.bytes;
+
+   mOffset += size;
+   mFile.Prefetch(mOffset);
+
+   return true;
+}
+
+bool CBinFileReader::GetTimeRange(double& First, double& Last) const
+{
+   if (mIndex.IsEmpty())
+      return false;
+
+   First = mIndex.GetFirstTime();
+   Last = mIndex.GetLastTime();
+
+   return true;
+}
+
+CContainerStreamReader::CContainerStreamReader()
+{
+   mChunk = 0;
+   mRecordsLeft = 0;
+   mOffset = 0;
+}
+
+CContainerStreamReader::~CContainerStreamReader()
+{
+}
+
+bool CContainerStreamReader::Open(const CContainerIndex& Index, uint32_t StreamId)
+{
+   if (!mFile.Open(Index.GetFilename().c_str()))
+      return false;
+
+   mChunks = Index.GetStreamChunks(StreamId);
+
+   return Rewind();
+}
+
+bool CContainerStreamReader::Rewind()
+{
+   mChunk = 0;
+   mRecordsLeft = 0;
+   mOffset = 0;
+
+   return true;
+}
+
+bool CContainerStreamReader::Seek(double Time)
+{
+   TRecordHeader header;
+
+   Rewind();
+
+   // skip the chunks that end before Time
+   while (mChunk < mChunks.size() && mChunks[mChunk].last_time < Time)
+      mChunk++;
+
+   if (!NextChunk())
+      return false;
+
+   // then the records before Time in the chunk that holds it
+   while (mRecordsLeft > 0)
+   {
+      if (mOffset + sizeof(header) > mFile.GetSize())
+         return false;
+
+      memcpy(&header, mFile.GetData() + mOffset, sizeof(header));
+
+      if (header.time >= Time)
+         return true;
+
+      mOffset += sizeof(header) + header.bytes;
+      mRecordsLeft--;
+   }
+
+   return true;
+}
+
+bool CContainerStreamReader::GetTimeRange(double& First, double& Last) const
+{
+   if (mChunks.empty())
+      return false;
+
+   First = mChunks.front().first_time;
+   Last = mChunks.back().last_time;
+
+   return true;
+}
+
+// Moves to the start of the records of the next chunk of this stream.  The
+// chunk index only holds chunks that are entirely in the file.
+bool CContainerStreamReader::NextChunk()
+{
+   if (mChunk >= mChunks.size())
+      return false;
+
+   mOffset = mChunks[mChunk].offset + sizeof(TChunkHeader);
+   mRecordsLeft = mChunks[mChunk].num_records;
+   mChunk++;
+
+   if (mOffset > mFile.GetSize())
+      return false;
+
+   mFile.Prefetch(mOffset);
+
+   return true;
+}
+
+bool CContainerStreamReader::Next(TPlaybackRecord& Record)
+{
+   TRecordHeader header;
+
+   while (mRecordsLeft == 0)
+   {
+      if (!NextChunk())
+         return false;
+   }
+
+   if (mOffset + sizeof(header) > mFile.GetSize())
+      return false;
+
+   memcpy(&header, mFile.GetData() + mOffset, sizeof(header));
+   mOffset += sizeof(header);
+
+   if (header.bytes > mFile.GetSize() - mOffset)
+      return false;
+
+   Record.time      = header.time;
+   Record.real_time = header.real_time;
+   Record.bytes     = header.bytes;
+   Record.payload   = mFile.GetData() + mOffset;
+
+   mOffset += header.bytes;
+   mRecordsLeft--;
+
+   return true;
+}
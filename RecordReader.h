@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Record Reader
+//  Class:      C++ Header
+//  Filename:   RecordReader.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CStreamReader
+//! \brief Reads the records of one recorded stream in time order
+//!
+//! CBinFileReader reads a file_<ip>_<mc>.bin file (version 1, 2 or 3) and
+//! CContainerStreamReader reads one stream out of a session container.
+//!
+//! Both walk the file through a CMappedFile and return records that point at
+//! their payload inside the mapping, valid until the reader is closed.  The
+//! reference records of a deduplicated file point at the earlier copy of
+//! their payload, so the mapping is the only payload cache there is.  Delta
+//! records are decoded against the previous payload into a ring of
+//! DECODE_DEPTH buffers, so their payloads stay valid for the next
+//! DECODE_DEPTH - 1 records of the reader.
+//!
+//! Seek positions a reader so that Next returns the first record at or after
+//! a time.  .bin files use their CTimeIndex sidecar, containers use the time
+//! range of each chunk in the container index.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "RecordFile.h"
+#include "Container.h"
+#include "TimeIndex.h"
+#include "MappedFile.h"
+
+struct TPlaybackRecord
+{
+   double      time;
+   double      real_time;
+   uint64_t    bytes;
+   const char* payload; // inside the reader's mapping
+};
+
+class CStreamReader
+{
+public:
+   virtual ~CStreamReader() {}
+
+   virtual bool Rewind() = 0;
+   virtual bool Seek(double Time) = 0;
+   virtual bool Next(TPlaybackRecord& Record) = 0;
+
+   // time of the first and last record
+   virtual bool GetTimeRange(double& First, double& Last) const = 0;
+};
+
+class CBinFileReader : public CStreamReader
+{
+public:
+   static constexpr uint32_t DECODE_DEPTH = 128;
+
+   CBinFileReader();
+   ~CBinFileReader() override;
+
+   bool Open(const char* Filename);
+
+   bool Rewind() override;
+   bool Seek(double Time) override;
+   bool Next(TPlaybackRecord& Record) override;
+   bool GetTimeRange(double& First, double& Last) const override;
+
+   uint32_t GetVersion() const { return mVersion; }
+
+private:
+   bool ReadHeader(uint64_t Offset, TRecordHeader& Header, uint64_t& Size, uint64_t& PayloadOffset) const;
+
+   CMappedFile       mFile;
+   uint32_t          mVersion;
+   uint64_t          mDataOffset;
+   uint64_t          mOffset;        // next record
+   CTimeIndex        mIndex;
+
+   // delta records
+   const char*       mPrevious;      // previous payload, NULL before the first
+   uint64_t          mPreviousBytes;
+   std::vector<char> mDecoded[DECODE_DEPTH];
+   uint32_t          mSlot;          // next decode buffer
+};
+
+class CContainerStreamReader : public CStreamReader
+{
+public:
+   CContainerStreamReader();
+   ~CContainerStreamReader() override;
+
+   bool Open(const CContainerIndex& Index, uint32_t StreamId);
+
+   bool Rewind() override;
+   bool Seek(double Time) override;
+   bool Next(TPlaybackRecord& Record) override;
+   bool GetTimeRange(double& First, double& Last) const override;
+
+private:
+   bool NextChunk();
+
+   CMappedFile                   mFile;
+   std::vector<TChunkIndexEntry> mChunks;
+   size_t                        mChunk;       // next chunk to read
+   uint32_t                      mRecordsLeft; // records left in the current chunk
+   uint64_t                      mOffset;      // next record in the current chunk
+};
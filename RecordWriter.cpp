@@ -0,0 +1,742 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Record Writer
+//  Class:      C++ Source
+//  Filename:   RecordWriter.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include "SimTimer.h"
+#include "RecordWriter.h"
+
+// io_uring user data of a sync, requests are aligned so their low bit is clear
+static constexpr uint64_t SYNC_TAG = 1;
+
+CRecordWriter::CRecordWriter()
+{
+   mBackend = WRITER_PWRITEV;
+   mQueueDepth = 1;
+   mInFlight = 0;
+   mDirect = false;
+   mLatency = nullptr;
+   mReleaseArena = nullptr;
+   mBytesQueued = 0;
+   mBytesWritten = 0;
+   mBytesCompleted = 0;
+   mWrites = 0;
+   mErrors = 0;
+   mMaxInFlight = 0;
+   mSyncBytes = 0;
+   mSyncInterval = 0.0;
+   mSyncsInFlight = 0;
+   mSyncTarget = 0;
+   mSyncIssued = 0.0;
+   mSynced = 0.0;
+   mSyncs = 0;
+   mBytesSynced = 0;
+   mMaxBytesAtRisk = 0;
+   mMaxTimeAtRisk = 0.0;
+}
+
+CRecordWriter::~CRecordWriter()
+{
+   Close();
+
+   for (size_t i = 0; i < mAllRequests.size(); i++)
+   {
+      free(mAllRequests[i]->block);
+      delete mAllRequests[i];
+   }
+}
+
+// Selects the backend.  Asking for io_uring falls back to pwritev if the
+// kernel does not allow it, check GetBackend() for what was used.
+bool CRecordWriter::Open(eWriterBackend Backend, unsigned int QueueDepth, bool Direct)
+{
+   mBackend = WRITER_PWRITEV;
+   mQueueDepth = QueueDepth ? QueueDepth : 1;
+   mDirect = Direct;
+   mSynced = CSimTimer::GetCurrentTime();
+
+   if (Backend == WRITER_IO_URING)
+   {
+      if (mRing.Open(mQueueDepth))
+         mBackend = WRITER_IO_URING;
+      else
+         perror("CRecordWriter::Open(): io_uring not available, using pwritev");
+   }
+
+   if (mBackend == WRITER_PWRITEV)
+      mQueueDepth = 1;
+
+   return true;
+}
+
+void CRecordWriter::Close()
+{
+   bool sync = (mSyncBytes || mSyncInterval > 0.0);
+   bool synced = false;
+
+   Submit(true);
+
+   while (mInFlight > 0 || mSyncsInFlight > 0)
+      Reap(true);
+
+   for (size_t i = 0; i < mFiles.size(); i++)
+   {
+      if (mFiles[i].fd < 0)
+         continue;
+
+      // the last sector was padded out
+      if (mFiles[i].truncate && ftruncate(mFiles[i].fd, mFiles[i].offset) != 0)
+         perror("CRecordWriter::Close(): ftruncate()");
+
+      if (sync && mFiles[i].dirty)
+      {
+         if (fdatasync(mFiles[i].fd) != 0)
+         {
+            perror("CRecordWriter::Close(): fdatasync()");
+            mErrors++;
+         }
+
+         mFiles[i].dirty = false;
+         synced = true;
+      }
+
+      close(mFiles[i].fd);
+      mFiles[i].fd = -1;
+   }
+
+   if (synced)
+   {
+      mSyncTarget = mBytesCompleted;
+      mSyncIssued = CSimTimer::GetCurrentTime();
+      FinishSync();
+   }
+
+   mRing.Close();
+}
+
+// Sets when written data is synced: once SyncBytes more have been written
+// or SyncInterval seconds have passed, whichever comes first
+void CRecordWriter::SetSyncPolicy(uint64_t SyncBytes, double SyncInterval)
+{
+   mSyncBytes = SyncBytes;
+   mSyncInterval = SyncInterval;
+}
+
+// Starts a sync when the policy calls for one and keeps the data at risk
+void CRecordWriter::Service(double Now)
+{
+   uint64_t at_risk = mBytesQueued - mBytesSynced;
+
+   if (at_risk > mMaxBytesAtRisk)
+      mMaxBytesAtRisk = at_risk;
+
+   // nothing at risk, so none of it has been waiting
+   if (at_risk == 0)
+      mSynced = Now;
+   else if (Now - mSynced > mMaxTimeAtRisk)
+      mMaxTimeAtRisk = Now - mSynced;
+
+   if (mSyncsInFlight > 0 || mBytesCompleted == mSyncTarget)
+      return;
+
+   if ((mSyncBytes && mBytesCompleted - mBytesSynced >= mSyncBytes) ||
+       (mSyncInterval > 0.0 && Now - mSyncIssued >= mSyncInterval))
+   {
+      StartSync(Now);
+   }
+}
+
+// Syncs every file written since the last sync
+void CRecordWriter::StartSync(double Now)
+{
+   mSyncTarget = mBytesCompleted;
+   mSyncIssued = Now;
+
+   for (size_t i = 0; i < mFiles.size(); i++)
+   {
+      if (!mFiles[i].dirty || mFiles[i].fd < 0)
+         continue;
+
+      mFiles[i].dirty = false;
+
+      if (mBackend == WRITER_PWRITEV)
+      {
+         if (fdatasync(mFiles[i].fd) != 0)
+         {
+            perror("CRecordWriter::StartSync(): fdatasync()");
+            mErrors++;
+         }
+         continue;
+      }
+
+      while (mRing.SpaceLeft() == 0)
+      {
+         mRing.Submit(0);
+         Reap(true);
+      }
+
+      mRing.PrepFdatasync(mFiles[i].fd, (i << 1) | SYNC_TAG);
+      mSyncsInFlight++;
+   }
+
+   if (mSyncsInFlight == 0)
+      FinishSync();
+   else
+      mRing.Submit(0);
+}
+
+void CRecordWriter::FinishSync()
+{
+   mBytesSynced = mSyncTarget;
+   mSynced = mSyncIssued;
+   mSyncs++;
+}
+
+// Creates (or truncates) a file and returns its index for Append.  With
+// Preallocate the file is instead kept and its blocks allocated up front, so
+// writing it never has to grow it.
+int CRecordWriter::OpenFile(const char* Filename, uint64_t Preallocate)
+{
+   TWriteFile file;
+   int        flags = O_WRONLY | O_CREAT | O_CLOEXEC | (Preallocate ? 0 : O_TRUNC);
+
+   file.fd = open(Filename, flags | (mDirect ? O_DIRECT : 0), 0644);
+
+   // some file systems (tmpfs) have no O_DIRECT, the aligned writes work anyway
+   if (file.fd < 0 && mDirect && errno == EINVAL)
+   {
+      fprintf(stderr, "CRecordWriter::OpenFile(): %s: O_DIRECT not supported, writing through the page cache\n", Filename);
+      file.fd = open(Filename, flags, 0644);
+   }
+
+   if (file.fd < 0)
+   {
+      fprintf(stderr, "CRecordWriter::OpenFile(): %s: %s\n", Filename, strerror(errno));
+      return -1;
+   }
+
+   if (Preallocate && fallocate(file.fd, 0, 0, Preallocate) != 0)
+   {
+      // file systems without fallocate get the blocks written out instead
+      int status = posix_fallocate(file.fd, 0, Preallocate);
+
+      if (status != 0)
+      {
+         fprintf(stderr, "CRecordWriter::OpenFile(): %s: could not preallocate: %s\n", Filename, strerror(status));
+         close(file.fd);
+         return -1;
+      }
+   }
+
+   file.offset = 0;
+   file.completed = 0;
+   file.in_flight = 0;
+   file.flushed = 0;
+   file.rewrite = false;
+   file.truncate = mDirect && !Preallocate;
+   file.dirty = false;
+   file.pending = nullptr;
+
+   mFiles.push_back(file);
+
+   return (int)mFiles.size() - 1;
+}
+
+// Starts writing File over again from the start, for a file that is reused
+// in place.  Writes still in flight to it are waited for, so they cannot
+// land on top of the new data.
+void CRecordWriter::Rewind(int File)
+{
+   Flush(File);
+
+   if (mFiles[File].in_flight > 0)
+   {
+      mRing.Submit(0);
+
+      while (mFiles[File].in_flight > 0)
+         Reap(true);
+   }
+
+   mFiles[File].offset = 0;
+   mFiles[File].completed = 0;
+   mFiles[File].flushed = 0;
+   mFiles[File].rewrite = false;
+   mFiles[File].done.clear();
+}
+
+// Returns the request being built for File, flushing the current one first
+// if it cannot take another iovec (or CopyBytes more staged bytes).
+CRecordWriter::TWriteRequest* CRecordWriter::GetPending(int File, size_t CopyBytes)
+{
+   TWriteRequest* request = mFiles[File].pending;
+
+   if (request && (mDirect ? request->bytes + CopyBytes > DIRECT_BYTES :
+                            (request->iov.size() >= MAX_IOV ||
+                             request->staging.size() + CopyBytes > request->staging.capacity())))
+   {
+      Flush(File, false);
+      request = nullptr;
+   }
+
+   if (!request)
+   {
+      if (mFreeRequests.empty())
+      {
+         request = new TWriteRequest;
+         request->iov.reserve(MAX_IOV);
+         request->records.reserve(MAX_IOV);
+         request->block = nullptr;
+
+         mAllRequests.push_back(request);
+
+         if (mDirect)
+         {
+            request->block = (char*)aligned_alloc(DIRECT_ALIGN, DIRECT_BYTES);
+
+            if (!request->block)
+               throw std::bad_alloc();
+         }
+         else
+         {
+            request->staging.reserve(STAGING_BYTES);
+         }
+      }
+      else
+      {
+         request = mFreeRequests.back();
+         mFreeRequests.pop_back();
+      }
+
+      if (!mDirect && CopyBytes > request->staging.capacity())
+         request->staging.reserve(CopyBytes);
+
+      request->file = File;
+      request->offset = mFiles[File].offset;
+      request->bytes = 0;
+      request->start = mFiles[File].flushed;
+
+      // a direct write starts on a sector, with what is already known of it
+      if (mDirect)
+      {
+         request->bytes = mFiles[File].offset % DIRECT_ALIGN;
+         request->offset -= request->bytes;
+         memcpy(request->block, mFiles[File].tail, request->bytes);
+      }
+
+      mFiles[File].pending = request;
+   }
+
+   return request;
+}
+
+// Gives a record copied to a direct block back to its arena, the arena is
+// flushed when the next record is from another one or on Submit
+void CRecordWriter::Release(TPacketRecord* Record)
+{
+   if (Record->slab->arena != mReleaseArena)
+   {
+      if (mReleaseArena)
+         mReleaseArena->Flush();
+
+      mReleaseArena = Record->slab->arena;
+   }
+
+   mReleaseArena->Release(Record);
+}
+
+// Copies data into the block of a direct request
+void CRecordWriter::Copy(TWriteRequest* Request, const void* Data, size_t Bytes)
+{
+   memcpy(Request->block + Request->bytes, Data, Bytes);
+   Request->bytes += Bytes;
+   mFiles[Request->file].offset += Bytes;
+   mBytesQueued += Bytes;
+}
+
+// Queues a copy of Data, for things like file headers and container footers
+void CRecordWriter::Append(int File, const void* Data, size_t Bytes)
+{
+   // a direct block holds at most DIRECT_BYTES, with the partial sector a
+   // new request starts with, so larger data goes in pieces
+   if (mDirect)
+   {
+      const char* data = (const char*)Data;
+
+      while (Bytes > 0)
+      {
+         size_t piece = std::min(Bytes, DIRECT_BYTES - DIRECT_ALIGN);
+
+         Copy(GetPending(File, piece), data, piece);
+         data += piece;
+         Bytes -= piece;
+      }
+
+      return;
+   }
+
+   TWriteRequest* request = GetPending(File, Bytes);
+   size_t         start = request->staging.size();
+   struct iovec   iov;
+
+   request->staging.insert(request->staging.end(), (const char*)Data, (const char*)Data + Bytes);
+
+   iov.iov_base = &request->staging[start];
+   iov.iov_len = Bytes;
+   request->iov.push_back(iov);
+   request->bytes += Bytes;
+   mFiles[File].offset += Bytes;
+   mBytesQueued += Bytes;
+}
+
+// Queues a record straight from the arena, it is released once written.
+// With Direct it is copied to the block and released straight away.
+void CRecordWriter::Append(int File, TPacketRecord* Record)
+{
+   TWriteRequest* request = GetPending(File, mDirect ? Record->DiskBytes() : 0);
+   struct iovec   iov;
+
+   if (mDirect)
+   {
+      if (mLatency)
+         request->times.push_back(Record->header.time);
+
+      Copy(request, Record->DiskData(), Record->DiskBytes());
+      Release(Record);
+   }
+   else
+   {
+      request->records.push_back(Record);
+
+      iov.iov_base = (void*)Record->DiskData();
+      iov.iov_len = Record->DiskBytes();
+      request->iov.push_back(iov);
+      request->bytes += iov.iov_len;
+      mFiles[File].offset += iov.iov_len;
+      mBytesQueued += iov.iov_len;
+   }
+
+   if (request->bytes >= COALESCE_BYTES)
+      Flush(File, false);
+}
+
+// Sends every file's pending request (All) or just the ones that have
+// grown large enough to be worth a write.
+void CRecordWriter::Submit(bool All)
+{
+   if (mReleaseArena)
+   {
+      mReleaseArena->Flush();
+      mReleaseArena = nullptr;
+   }
+
+   for (size_t i = 0; i < mFiles.size(); i++)
+   {
+      if (mFiles[i].pending && (All || mFiles[i].pending->bytes >= COALESCE_BYTES))
+         Flush(i, All);
+   }
+
+   if (mBackend == WRITER_IO_URING)
+      mRing.Submit(0);
+}
+
+// Writes the pending request of File.  With Direct only whole sectors can
+// be written: Pad writes the last partial one padded with zeros, otherwise
+// it is left for the next request.
+void CRecordWriter::Flush(int File, bool Pad)
+{
+   TWriteFile&    file = mFiles[File];
+   TWriteRequest* request = file.pending;
+
+   if (!request)
+      return;
+
+   file.pending = nullptr;
+
+   if (mDirect)
+   {
+      size_t whole = request->bytes & ~(DIRECT_ALIGN - 1);
+      size_t partial = request->bytes - whole;
+
+      if (whole == 0)
+         Pad = true;
+
+      memcpy(file.tail, request->block + whole, partial);
+
+      if (Pad && partial)
+      {
+         memset(request->block + request->bytes, 0, DIRECT_ALIGN - partial);
+         request->end = request->offset + request->bytes;
+         request->bytes = whole + DIRECT_ALIGN;
+      }
+      else
+      {
+         request->end = request->offset + whole;
+         request->bytes = whole;
+      }
+
+      request->iov.resize(1);
+      request->iov[0].iov_base = request->block;
+      request->iov[0].iov_len = request->bytes;
+
+      // this request writes the padded sector of the last one again, which
+      // must not still be on its way
+      if (file.rewrite && file.in_flight > 0)
+      {
+         mRing.Submit(0);
+
+         while (file.in_flight > 0)
+            Reap(true);
+      }
+
+      file.rewrite = Pad && partial;
+   }
+   else
+   {
+      request->end = request->offset + request->bytes;
+   }
+
+   file.flushed = request->end;
+
+   if (mBackend == WRITER_PWRITEV)
+   {
+      WriteSync(request, 0);
+      Complete(request);
+      return;
+   }
+
+   // keep no more than QueueDepth writes in flight
+   while (mInFlight >= mQueueDepth || mRing.SpaceLeft() == 0)
+   {
+      mRing.Submit(0);
+      Reap(true);
+   }
+
+   mRing.PrepWritev(file.fd, request->iov.data(), request->iov.size(), request->offset, (uint64_t)(uintptr_t)request);
+   mInFlight++;
+   file.in_flight++;
+
+   if (mInFlight > mMaxInFlight)
+      mMaxInFlight = mInFlight;
+}
+
+// Writes whatever is left of a request past its first Done bytes.  With
+// Direct a short write is picked up again from its last whole sector.
+void CRecordWriter::WriteSync(TWriteRequest* Request, size_t Done)
+{
+   struct iovec* iov = Request->iov.data();
+   int           num_iov = Request->iov.size();
+   uint64_t      offset;
+
+   if (mDirect)
+      Done &= ~(DIRECT_ALIGN - 1);
+
+   offset = Request->offset + Done;
+
+   // skip the iovecs that were already written
+   while (num_iov > 0 && Done >= iov->iov_len)
+   {
+      Done -= iov->iov_len;
+      iov++;
+      num_iov--;
+   }
+
+   if (num_iov > 0)
+   {
+      iov->iov_base = (char*)iov->iov_base + Done;
+      iov->iov_len -= Done;
+   }
+
+   while (num_iov > 0)
+   {
+      ssize_t status = pwritev(mFiles[Request->file].fd, iov, num_iov, offset);
+
+      if (status < 0)
+      {
+         if (errno == EINTR)
+            continue;
+
+         perror("CRecordWriter::WriteSync(): pwritev()");
+         mErrors++;
+         return;
+      }
+
+      mWrites++;
+      mBytesWritten += status;
+
+      if (mDirect)
+      {
+         status &= ~(ssize_t)(DIRECT_ALIGN - 1);
+
+         if (status == 0)
+         {
+            fprintf(stderr, "CRecordWriter::WriteSync(): pwritev() wrote less than a sector\n");
+            mErrors++;
+            return;
+         }
+      }
+
+      offset += status;
+
+      while (num_iov > 0 && (size_t)status >= iov->iov_len)
+      {
+         status -= iov->iov_len;
+         iov++;
+         num_iov--;
+      }
+
+      if (num_iov > 0)
+      {
+         iov->iov_base = (char*)iov->iov_base + status;
+         iov->iov_len -= status;
+      }
+   }
+}
+
+// Handles finished io_uring writes and syncs.  With Wait set, blocks for at
+// least one.
+void CRecordWriter::Reap(bool Wait)
+{
+   uint64_t user_data;
+   int      result;
+
+   if (mBackend != WRITER_IO_URING || (mInFlight == 0 && mSyncsInFlight == 0))
+      return;
+
+   if (Wait)
+      mRing.Submit(1);
+
+   while (mRing.PeekCompletion(user_data, result))
+   {
+      if (user_data & SYNC_TAG)
+      {
+         if (result < 0)
+         {
+            fprintf(stderr, "CRecordWriter::Reap(): sync failed: %s\n", strerror(-result));
+            mErrors++;
+         }
+
+         if (--mSyncsInFlight == 0)
+            FinishSync();
+
+         continue;
+      }
+
+      TWriteRequest* request = (TWriteRequest*)(uintptr_t)user_data;
+
+      mInFlight--;
+      mFiles[request->file].in_flight--;
+
+      if (result < 0)
+      {
+         fprintf(stderr, "CRecordWriter::Reap(): write failed: %s\n", strerror(-result));
+         mErrors++;
+      }
+      else
+      {
+         mWrites++;
+         mBytesWritten += result;
+
+         // short write, finish it off synchronously
+         if ((size_t)result < request->bytes)
+            WriteSync(request, result);
+      }
+
+      Complete(request);
+   }
+}
+
+// The data is on its way to disk, give the arena records back
+void CRecordWriter::Complete(TWriteRequest* Request)
+{
+   TWriteFile& file = mFiles[Request->file];
+
+   mBytesCompleted += Request->end - Request->start;
+   file.dirty = true;
+
+   // the file is complete up to the first request not yet back, io_uring can
+   // finish them out of order (and a direct write can start before the end
+   // of the one before)
+   if (Request->offset <= file.completed)
+   {
+      file.completed = std::max(file.completed, Request->end);
+
+      for (auto next = file.done.begin(); next != file.done.end() && next->first <= file.completed; )
+      {
+         file.completed = std::max(file.completed, next->second);
+         next = file.done.erase(next);
+      }
+   }
+   else
+   {
+      file.done[Request->offset] = std::max(file.done[Request->offset], Request->end);
+   }
+
+   if (mLatency && (!Request->records.empty() || !Request->times.empty()))
+   {
+      double now = CSimTimer::GetCurrentTime();
+
+      for (size_t i = 0; i < Request->records.size(); i++)
+         mLatency->Add(now - Request->records[i]->header.time);
+
+      for (size_t i = 0; i < Request->times.size(); i++)
+         mLatency->Add(now - Request->times[i]);
+   }
+
+   // each record goes back to the arena of the receive thread that made it
+   CPacketArena* arena = nullptr;
+
+   for (size_t i = 0; i < Request->records.size(); i++)
+   {
+      if (Request->records[i]->slab->arena != arena)
+      {
+         if (arena)
+            arena->Flush();
+
+         arena = Request->records[i]->slab->arena;
+      }
+
+      arena->Release(Request->records[i]);
+   }
+
+   if (arena)
+      arena->Flush();
+
+   Request->iov.clear();
+   Request->records.clear();
+   Request->times.clear();
+   Request->staging.clear();
+
+   mFreeRequests.push_back(Request);
+}
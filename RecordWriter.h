@@ -0,0 +1,196 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Record Writer
+//  Class:      C++ Header
+//  Filename:   RecordWriter.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CRecordWriter
+//! \brief Batched, asynchronous writer for recording files
+//!
+//! Records appended to a file are gathered into one writev request per file
+//! (up to COALESCE_BYTES or MAX_IOV records) that points straight at the
+//! packet arena.  Requests go out through io_uring with up to QueueDepth of
+//! them in flight, and the arena records are only released when the kernel
+//! reports the write complete.  If io_uring is not available the same
+//! requests are written synchronously with pwritev.
+//!
+//! If given a latency histogram, the writer adds the time from receive to
+//! write completion of every record to it, with one clock read per request.
+//!
+//! With Direct the files are opened O_DIRECT.  Records are then copied into
+//! an aligned block per request instead, and only whole DIRECT_ALIGN sectors
+//! are written: the partial last sector is carried into the next request,
+//! or, when a flush must write everything, padded and written again (after
+//! the first write is back) by the next request.  Files not preallocated are
+//! truncated to their length on Close.
+//!
+//! The sync policy issues an fdatasync of every file written since the last
+//! one once SyncBytes more bytes have been written or SyncInterval seconds
+//! have passed, through io_uring when it is in use.  Each sync covers the
+//! writes completed before it was issued.  Close always syncs unless the
+//! policy is never (both zero).  The writer keeps the most bytes and the
+//! longest time that were queued but not yet synced, as the data at risk.
+//!
+//! GetCompleted tells how far a file has been written without a gap, for a
+//! reader that must only look at data that is really there.  A file opened
+//! with Preallocate is kept and fully allocated, and Rewind starts it over
+//! in place, for files that are reused rather than recreated.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <sys/uio.h>
+#include "IoUring.h"
+#include "PacketArena.h"
+#include "Metrics.h"
+
+enum eWriterBackend {WRITER_PWRITEV, WRITER_IO_URING};
+
+class CRecordWriter
+{
+public:
+   static constexpr size_t COALESCE_BYTES = 256 * 1024;
+   static constexpr int    MAX_IOV        = 1024;
+   static constexpr size_t STAGING_BYTES  = 4096;
+   static constexpr size_t DIRECT_ALIGN   = 4096;
+   static constexpr size_t DIRECT_BYTES   = COALESCE_BYTES + 128 * 1024; // block of a request with Direct
+
+   CRecordWriter();
+   ~CRecordWriter();
+
+   CRecordWriter(const CRecordWriter&) = delete;
+   CRecordWriter& operator=(const CRecordWriter&) = delete;
+
+   bool Open(eWriterBackend Backend, unsigned int QueueDepth, bool Direct = false);
+   void Close();
+
+   void SetSyncPolicy(uint64_t SyncBytes, double SyncInterval);
+   void Service(double Now);
+
+   int  OpenFile(const char* Filename, uint64_t Preallocate = 0);
+   void Rewind(int File);
+
+   void Append(int File, const void* Data, size_t Bytes);
+   void Append(int File, TPacketRecord* Record);
+
+   void Submit(bool All);
+   void Reap(bool Wait);
+
+   void SetLatencyHistogram(CLatencyHistogram* Histogram) { mLatency = Histogram; }
+
+   eWriterBackend GetBackend() const { return mBackend; }
+   const char*    GetBackendName() const { return mBackend == WRITER_IO_URING ? "io_uring" : "pwritev"; }
+   int            GetNumFiles() const { return (int)mFiles.size(); }
+   uint64_t       GetOffset(int File) const { return mFiles[File].offset; }
+   uint64_t       GetCompleted(int File) const { return mFiles[File].completed; }
+   unsigned int   GetInFlight() const { return mInFlight; }
+
+   uint64_t       GetBytesQueued() const { return mBytesQueued; }
+   uint64_t       GetBytesWritten() const { return mBytesWritten; }
+   uint64_t       GetBytesCompleted() const { return mBytesCompleted; }
+   uint64_t       GetWrites() const { return mWrites; }
+   uint64_t       GetErrors() const { return mErrors; }
+   unsigned int   GetMaxInFlight() const { return mMaxInFlight; }
+   bool           IsDirect() const { return mDirect; }
+
+   uint64_t       GetSyncs() const { return mSyncs; }
+   uint64_t       GetBytesSynced() const { return mBytesSynced; }
+   uint64_t       GetBytesAtRisk() const { return mBytesQueued - mBytesSynced; }
+   uint64_t       GetMaxBytesAtRisk() const { return mMaxBytesAtRisk; }
+   double         GetMaxTimeAtRisk() const { return mMaxTimeAtRisk; }
+
+private:
+   struct TWriteRequest
+   {
+      int                         file;
+      uint64_t                    offset;  // where the write starts
+      size_t                      bytes;   // written, or gathered in block with Direct until flushed
+      uint64_t                    start;   // file data not written before starts here
+      uint64_t                    end;     // and ends here
+      std::vector<struct iovec>   iov;
+      std::vector<TPacketRecord*> records;
+      std::vector<double>         times;   // receive times of the records copied to block, with Direct
+      std::vector<char>           staging; // copied data, never grows past its reserved size
+      char*                       block;   // DIRECT_BYTES aligned to DIRECT_ALIGN, with Direct
+   };
+
+   struct TWriteFile
+   {
+      int                          fd;
+      uint64_t                     offset;     // of the next Append
+      uint64_t                     completed;  // everything before has been written
+      unsigned int                 in_flight;
+      std::map<uint64_t, uint64_t> done;       // writes finished past completed, start to end
+      uint64_t                     flushed;    // end of the data handed to a write
+      bool                         rewrite;    // the last write was padded, its sector is written again
+      bool                         truncate;   // to offset on Close, with Direct
+      bool                         dirty;      // written since the last sync
+      char                         tail[DIRECT_ALIGN]; // partial last sector, with Direct
+      TWriteRequest*               pending;
+   };
+
+   TWriteRequest* GetPending(int File, size_t CopyBytes);
+   void           Copy(TWriteRequest* Request, const void* Data, size_t Bytes);
+   void           Release(TPacketRecord* Record);
+   void           Flush(int File, bool Pad = true);
+   void           WriteSync(TWriteRequest* Request, size_t Done);
+   void           Complete(TWriteRequest* Request);
+   void           StartSync(double Now);
+   void           FinishSync();
+
+   CIoUring                    mRing;
+   eWriterBackend              mBackend;
+   unsigned int                mQueueDepth;
+   unsigned int                mInFlight;     // writes
+   bool                        mDirect;
+
+   std::vector<TWriteFile>     mFiles;
+   std::vector<TWriteRequest*> mFreeRequests;
+   std::vector<TWriteRequest*> mAllRequests;
+
+   CLatencyHistogram*          mLatency;      // receive to disk, may be NULL
+   CPacketArena*               mReleaseArena; // of records copied since the last Submit, with Direct
+
+   uint64_t                    mBytesQueued;
+   uint64_t                    mBytesWritten;   // by the writes, including sectors written again
+   uint64_t                    mBytesCompleted; // of file data
+   uint64_t                    mWrites;
+   uint64_t                    mErrors;
+   unsigned int                mMaxInFlight;
+
+   // sync policy, zero for never
+   uint64_t                    mSyncBytes;
+   double                      mSyncInterval;
+
+   unsigned int                mSyncsInFlight;
+   uint64_t                    mSyncTarget;     // mBytesCompleted when the syncs in flight were issued
+   double                      mSyncIssued;
+   double                      mSynced;         // issue time of the last finished sync
+   uint64_t                    mSyncs;
+   uint64_t                    mBytesSynced;
+   uint64_t                    mMaxBytesAtRisk;
+   double                      mMaxTimeAtRisk;
+};
@@ -116,3 +116,11 @@ double CSimTimer::GetCurrentTime()
    clock_gettime(CLOCK_MONOTONIC, &tm);
    return (double)tm.tv_sec + (double)tm.tv_nsec / 1000000000.0;
 }
+
+double CSimTimer::GetRealTime()
+{
+   struct timespec tm;
+
+   clock_gettime(CLOCK_REALTIME, &tm);
+   return (double)tm.tv_sec + (double)tm.tv_nsec / 1000000000.0;
+}
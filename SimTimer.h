@@ -84,6 +84,7 @@ class CSimTimer
 
    static void GetCurrentTimeStr(char*);
    static double GetCurrentTime();
+   static double GetRealTime();
 
 private:
 
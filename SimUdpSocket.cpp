@@ -45,12 +45,16 @@ CSimUdpSocket::CSimUdpSocket()
 {
    // initialize
    mIsOpen = false;
+   mReusePort = false;
+   mKernelDrops = 0;
 }
 
 CSimUdpSocket::CSimUdpSocket(const char *IpAddress, int SendPort, int RecvPort)
 {
    // initialize
    mIsOpen = false;
+   mReusePort = false;
+   mKernelDrops = 0;
 
    // open the socket
    Open(IpAddress, SendPort, RecvPort);
@@ -58,7 +62,8 @@ CSimUdpSocket::CSimUdpSocket(const char *IpAddress, int SendPort, int RecvPort)
 
 CSimUdpSocket::~CSimUdpSocket()
 {
-   close(mSocket);
+   if (mIsOpen)
+      close(mSocket);
 }
 
 bool CSimUdpSocket::Open(const char *IpAddress, int SendPort, int RecvPort)
@@ -92,10 +97,6 @@ bool CSimUdpSocket::Open(const char *IpAddress, int SendPort, int RecvPort)
       return false;
    }
 
-   int bufSize = 65536;
-   setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, (char *)&bufSize, sizeof(int));
-   setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, (char *)&bufSize, sizeof(int));
-
    // Set the socket options for broadcast address
    if (setsockopt(mSocket, SOL_SOCKET, SO_BROADCAST, &optval, sizeof(optval)) < 0)
    {
@@ -109,6 +110,13 @@ bool CSimUdpSocket::Open(const char *IpAddress, int SendPort, int RecvPort)
       return false;
    }
 
+   // several sockets share the port, unicast is spread over them by flow
+   if (mReusePort && setsockopt(mSocket, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+   {
+      perror(" UDP Port Constructor: SetSockOpt()");
+      return false;
+   }
+
    // include struct in_pktinfo in the message "ancilliary" control data
    setsockopt(mSocket, IPPROTO_IP, IP_PKTINFO, &optval, sizeof(optval));
 
@@ -124,6 +132,62 @@ bool CSimUdpSocket::Open(const char *IpAddress, int SendPort, int RecvPort)
    return true;
 }
 
+// Opens a socket that only transmits.  Nothing is received, so no groups
+// need to be joined; the socket is only bound when a SourcePort is given so
+// datagrams keep a fixed source port.  IpAddr/SendPort is the default
+// destination, SendBatch can name another per message.
+bool CSimUdpSocket::OpenSend(const char *IpAddress, int SendPort, int SourcePort)
+{
+   int optval = 1;
+
+   // check if already open
+   if (mIsOpen)
+      return true;
+
+   strncpy(mIpAddress, IpAddress, sizeof(mIpAddress));
+   mSendPort = SendPort;
+   mReceivePort = SourcePort;
+
+   // Initialize the output socket structure
+   memset(&mAddressOut, 0, sizeof(mAddressOut));
+   mAddressOut.sin_addr.s_addr = inet_addr(IpAddress);
+   mAddressOut.sin_family = AF_INET;
+   mAddressOut.sin_port = htons(SendPort);
+
+   if ((mSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+   {
+      perror("OpenSend(): socket()");
+      return false;
+   }
+
+   if (setsockopt(mSocket, SOL_SOCKET, SO_BROADCAST, &optval, sizeof(optval)) < 0 ||
+       setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0)
+   {
+      perror("OpenSend(): setsockopt()");
+      close(mSocket);
+      return false;
+   }
+
+   if (SourcePort)
+   {
+      memset(&mAddressIn, 0, sizeof(mAddressIn));
+      mAddressIn.sin_addr.s_addr = INADDR_ANY;
+      mAddressIn.sin_family = AF_INET;
+      mAddressIn.sin_port = htons(SourcePort);
+
+      if (bind(mSocket, (struct sockaddr *)&mAddressIn, sizeof(mAddressIn)) == -1)
+      {
+         perror("OpenSend(): bind()");
+         close(mSocket);
+         return false;
+      }
+   }
+
+   mIsOpen = true;
+
+   return true;
+}
+
 int CSimUdpSocket::SendToSocket(char *DataBuffer, int SizeInBytes)
 {
    int send_status; /* Status of sendto function call */
@@ -144,6 +208,62 @@ int CSimUdpSocket::SendToSocket(char *DataBuffer, int SizeInBytes)
    return 0;
 }
 
+// Sends a batch of datagrams with sendmmsg, MAX_BATCH per call.  A message
+// the kernel rejects is reported and skipped.  Returns the number sent.
+int CSimUdpSocket::SendBatch(const TUdpSendPacket* Packets, int NumPackets)
+{
+   struct mmsghdr msgs[MAX_BATCH];
+   struct iovec   iovs[MAX_BATCH];
+   int            num_sent = 0;
+   int            done = 0;
+
+   if (!mIsOpen)
+      return 0;
+
+   while (done < NumPackets)
+   {
+      int count = NumPackets - done;
+
+      if (count > MAX_BATCH)
+         count = MAX_BATCH;
+
+      memset(msgs, 0, count * sizeof(struct mmsghdr));
+
+      for (int i = 0; i < count; i++)
+      {
+         const TUdpSendPacket& packet = Packets[done + i];
+
+         iovs[i].iov_base = (void *)packet.buffer;
+         iovs[i].iov_len  = packet.bytes;
+
+         msgs[i].msg_hdr.msg_name    = (void *)(packet.to ? packet.to : &mAddressOut);
+         msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+         msgs[i].msg_hdr.msg_iov     = &iovs[i];
+         msgs[i].msg_hdr.msg_iovlen  = 1;
+      }
+
+      int status = sendmmsg(mSocket, msgs, count, 0);
+
+      if (status < 0)
+      {
+         if (errno == EINTR)
+            continue;
+
+         // the first message failed, drop it and carry on with the rest
+         perror("SendBatch(): sendmmsg()");
+         status = 1;
+      }
+      else
+      {
+         num_sent += status;
+      }
+
+      done += status;
+   }
+
+   return num_sent;
+}
+
 int CSimUdpSocket::ReceiveFromSocket(char *DataBuffer, int MaxSizeToRead)
 {
    int bytes_returned;
@@ -225,6 +345,85 @@ int CSimUdpSocket::ReceiveFromSocket(char *DataBuffer, int MaxSizeToRead, char*
    return (bytes_returned);
 }
 
+int CSimUdpSocket::ReceiveBatch(TUdpPacket* Packets, int NumPackets)
+{
+   struct mmsghdr     msgs[MAX_BATCH];
+   struct iovec       iovs[MAX_BATCH][2];
+   struct sockaddr_in addrs[MAX_BATCH];
+   char               cmsgbuffers[MAX_BATCH][CMSG_SPACE(sizeof(struct in_pktinfo)) +
+                                         CMSG_SPACE(sizeof(struct timespec)) +
+                                         CMSG_SPACE(sizeof(uint32_t))];
+   int                num_msgs;
+
+   if (!mIsOpen)
+      return 0;
+
+   if (NumPackets > MAX_BATCH)
+      NumPackets = MAX_BATCH;
+
+   memset(msgs, 0, sizeof(msgs[0]) * NumPackets);
+
+   for (int i = 0; i < NumPackets; i++)
+   {
+      iovs[i][0].iov_base = Packets[i].buffer;
+      iovs[i][0].iov_len = Packets[i].max_bytes;
+      iovs[i][1].iov_base = Packets[i].spill;
+      iovs[i][1].iov_len = Packets[i].spill_bytes;
+
+      msgs[i].msg_hdr.msg_iov = iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = Packets[i].spill ? 2 : 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      msgs[i].msg_hdr.msg_control = cmsgbuffers[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(cmsgbuffers[i]);
+   }
+
+   // block until at least one datagram arrives, then take whatever else is
+   // already queued without waiting again
+   num_msgs = recvmmsg(mSocket, msgs, NumPackets, MSG_WAITFORONE, NULL);
+
+   if (num_msgs == -1)
+   {
+      if (errno == EAGAIN || errno == EINTR)
+         return 0;
+      else
+         return -1;
+   }
+
+   for (int i = 0; i < num_msgs; i++)
+   {
+      struct msghdr* msghdr = &msgs[i].msg_hdr;
+
+      Packets[i].bytes = msgs[i].msg_len;
+      Packets[i].from_ip = addrs[i].sin_addr;
+      Packets[i].to_mcast_ip.s_addr = INADDR_ANY;
+      Packets[i].rx_time.tv_sec = 0;
+      Packets[i].rx_time.tv_nsec = 0;
+
+      for ( // iterate through all the control headers
+         struct cmsghdr *cmsg = CMSG_FIRSTHDR(msghdr);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(msghdr, cmsg))
+      {
+         if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+         {
+            struct in_pktinfo *pi = (struct in_pktinfo*)CMSG_DATA(cmsg);
+            Packets[i].to_mcast_ip = pi->ipi_addr;
+         }
+         else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+         {
+            memcpy(&Packets[i].rx_time, CMSG_DATA(cmsg), sizeof(struct timespec));
+         }
+         else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+         {
+            memcpy(&mKernelDrops, CMSG_DATA(cmsg), sizeof(mKernelDrops));
+         }
+      }
+   }
+
+   return num_msgs;
+}
+
 void CSimUdpSocket::SetNonBlockingFlag()
 {
    int socket_flags;
@@ -253,6 +452,94 @@ void CSimUdpSocket::ClearNonBlockingFlag()
    fcntl(mSocket, F_SETFL, socket_flags);
 }
 
+int CSimUdpSocket::EnableTimestamps()
+{
+   int optval = 1;
+
+   if (!mIsOpen)
+      return -1;
+
+   // have the kernel stamp each datagram as it is queued on the socket
+   int status = setsockopt(mSocket, SOL_SOCKET, SO_TIMESTAMPNS, &optval, sizeof(optval));
+
+   return status;
+}
+
+// Only deliver the groups this socket joined.  By default Linux hands a
+// socket bound to INADDR_ANY every group joined by any socket on the host.
+int CSimUdpSocket::SetMulticastAll(bool Enable)
+{
+   int optval = Enable ? 1 : 0;
+
+   if (!mIsOpen)
+      return -1;
+
+   int status = setsockopt(mSocket, IPPROTO_IP, IP_MULTICAST_ALL, &optval, sizeof(optval));
+
+   return status;
+}
+
+int CSimUdpSocket::EnableDropCounter()
+{
+   int optval = 1;
+
+   if (!mIsOpen)
+      return -1;
+
+   // have the kernel attach its drop count to each datagram
+   int status = setsockopt(mSocket, SOL_SOCKET, SO_RXQ_OVFL, &optval, sizeof(optval));
+
+   return status;
+}
+
+// Sets the receive buffer size, going past net.core.rmem_max with
+// SO_RCVBUFFORCE when the process has CAP_NET_ADMIN.  Returns the size the
+// kernel actually uses (it doubles the request for its own overhead), or -1.
+int CSimUdpSocket::SetReceiveBuffer(int Bytes)
+{
+   if (!mIsOpen)
+      return -1;
+
+   if (setsockopt(mSocket, SOL_SOCKET, SO_RCVBUFFORCE, &Bytes, sizeof(Bytes)) < 0)
+      setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &Bytes, sizeof(Bytes));
+
+   return GetReceiveBuffer();
+}
+
+// Same as SetReceiveBuffer for the send buffer (net.core.wmem_max)
+int CSimUdpSocket::SetSendBuffer(int Bytes)
+{
+   if (!mIsOpen)
+      return -1;
+
+   if (setsockopt(mSocket, SOL_SOCKET, SO_SNDBUFFORCE, &Bytes, sizeof(Bytes)) < 0)
+      setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, &Bytes, sizeof(Bytes));
+
+   return GetSendBuffer();
+}
+
+int CSimUdpSocket::GetReceiveBuffer() const
+{
+   int       bytes = -1;
+   socklen_t length = sizeof(bytes);
+
+   if (!mIsOpen || getsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &bytes, &length) < 0)
+      return -1;
+
+   return bytes;
+}
+
+int CSimUdpSocket::GetSendBuffer() const
+{
+   int       bytes = -1;
+   socklen_t length = sizeof(bytes);
+
+   if (!mIsOpen || getsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, &bytes, &length) < 0)
+      return -1;
+
+   return bytes;
+}
+
 int CSimUdpSocket::SetTtl(unsigned char ttl)
 {
    unsigned char theTtl = ttl;
@@ -28,32 +28,81 @@
 //!
 //! Provides functionality to open a UDP Ethernet socket and read/write data.
 //!
+//! Sockets keep the system default buffer sizes (net.core.rmem_default and
+//! wmem_default) unless SetReceiveBuffer/SetSendBuffer are called.  With
+//! EnableDropCounter the kernel's count of datagrams dropped on this socket
+//! for lack of buffer space comes back with every batch receive.
+//!
 //
 //------------------------------------------------------------------------------
 
 #pragma once
 
+#include <stdint.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+//! Slot for one datagram in a batch receive. The caller supplies the payload
+//! buffer and its size, ReceiveBatch fills in the rest.  An optional spill
+//! buffer catches whatever part of a datagram does not fit in buffer.
+struct TUdpPacket
+{
+   char*           buffer;      // caller supplied payload buffer
+   int             max_bytes;   // size of the payload buffer
+   char*           spill;       // optional overflow buffer for large datagrams (may be NULL)
+   int             spill_bytes; // size of the spill buffer
+   int             bytes;       // bytes received
+   struct in_addr  from_ip;     // source address of the sender
+   struct in_addr  to_mcast_ip; // destination group (from IP_PKTINFO)
+   struct timespec rx_time;     // kernel receive time, CLOCK_REALTIME (zero if not enabled)
+};
+
+//! One datagram in a batch send.  Each message can go to its own destination.
+struct TUdpSendPacket
+{
+   const void*               buffer;
+   int                       bytes;
+   const struct sockaddr_in* to;    // destination, NULL for the socket's send address
+};
+
 class CSimUdpSocket
 {
 public:
+   static constexpr int MAX_BATCH = 64;
+
    CSimUdpSocket();
    CSimUdpSocket(const char *IpAddr, int SendPort, int ReceivePort);
    ~CSimUdpSocket();
 
    bool Open(const char *IpAddr, int SendPort, int ReceivePort);
+   bool OpenSend(const char *IpAddr, int SendPort, int SourcePort);
 
    int SendToSocket(char *DataBuffer, int SizeInBytes);
+   int SendBatch(const TUdpSendPacket* Packets, int NumPackets);
    int ReceiveFromSocket(char *DataBuffer, int MaxSizeToRead);
    int ReceiveFromSocket(char *DataBuffer, int MaxSizeToRead, char* FromIp, char* ToMcastIp);
+   int ReceiveBatch(TUdpPacket* Packets, int NumPackets);
 
    void SetNonBlockingFlag();
    void ClearNonBlockingFlag();
 
    bool IsOpen() const { return mIsOpen; }
 
+   // must be set before Open, for several receive sockets sharing a port
+   void SetReusePort(bool Enable) { mReusePort = Enable; }
+
+   int EnableTimestamps();
+   int EnableDropCounter();
+   int SetMulticastAll(bool Enable);
+   int SetReceiveBuffer(int Bytes);
+   int SetSendBuffer(int Bytes);
+   int GetReceiveBuffer() const;
+   int GetSendBuffer() const;
+
+   // datagrams the kernel dropped so far, wraps at 2^32
+   uint32_t GetKernelDrops() const { return mKernelDrops; }
+
    int SetTtl(unsigned char ttl);
    int SetMultiCast(const char *device_ip);
    int JoinMcastGroup(const char *mcast_ip, const char *device_ip);
@@ -62,10 +111,12 @@ public:
 
 private:
    bool mIsOpen;
+   bool mReusePort;
    int mSocket;
    char mIpAddress[50];
    int mSendPort;
    int mReceivePort;
+   uint32_t mKernelDrops;
 
    struct sockaddr_in mAddressOut;
    struct sockaddr_in mAddressIn;
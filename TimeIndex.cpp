@@ -0,0 +1,239 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Time Index
+//  Class:      C++ Source
+//  Filename:   TimeIndex.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              See header file for details.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "RecordFile.h"
+#include "TimeIndex.h"
+
+CTimeIndex::CTimeIndex()
+{
+   Reset(0);
+}
+
+CTimeIndex::~CTimeIndex()
+{
+}
+
+std::string CTimeIndex::GetFilename(const std::string& BinFilename)
+{
+   return BinFilename + ".idx";
+}
+
+void CTimeIndex::Reset(uint64_t DataOffset)
+{
+   mEntries.clear();
+   mDataOffset = DataOffset;
+   mFirstTime = 0.0;
+   mLastTime = 0.0;
+}
+
+// Called for every record in file order, keeps the seekable ones that start
+// a new interval
+void CTimeIndex::Add(double Time, uint64_t Offset, bool Seekable)
+{
+   if (mEntries.empty())
+      mFirstTime = Time;
+
+   if (Seekable && StartsEntry(Time, Offset))
+      mEntries.push_back({ Time, Offset });
+
+   mLastTime = Time;
+}
+
+// True if a seekable record at Time and Offset would be kept as an entry
+bool CTimeIndex::StartsEntry(double Time, uint64_t Offset) const
+{
+   return mEntries.empty() || Time >= mEntries.back().time + INTERVAL || Offset >= mEntries.back().offset + MAX_GAP;
+}
+
+bool CTimeIndex::Save(const std::string& Filename, uint64_t FileSize) const
+{
+   TTimeIndexHeader header;
+   FILE*            file = fopen(Filename.c_str(), "wb");
+   bool             status;
+
+   if (!file)
+      return false;
+
+   memcpy(header.magic, TIME_INDEX_MAGIC, sizeof(header.magic));
+   header.version     = TIME_INDEX_VERSION;
+   header.num_entries = mEntries.size();
+   header.file_size   = FileSize;
+   header.data_offset = mDataOffset;
+   header.first_time  = mFirstTime;
+   header.last_time   = mLastTime;
+
+   status = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+   if (status && !mEntries.empty())
+      status = (fwrite(mEntries.data(), sizeof(TTimeIndexEntry), mEntries.size(), file) == mEntries.size());
+
+   fclose(file);
+
+   return status;
+}
+
+// Loads an index, failing if it does not match a .bin file of FileSize bytes
+bool CTimeIndex::Load(const std::string& Filename, uint64_t FileSize)
+{
+   TTimeIndexHeader header;
+   FILE*            file = fopen(Filename.c_str(), "rb");
+   bool             status = false;
+
+   if (!file)
+      return false;
+
+   if (fread(&header, sizeof(header), 1, file) == 1 &&
+       memcmp(header.magic, TIME_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+       header.version == TIME_INDEX_VERSION &&
+       header.file_size == FileSize)
+   {
+      Reset(header.data_offset);
+      mEntries.resize(header.num_entries);
+      mFirstTime = header.first_time;
+      mLastTime = header.last_time;
+
+      status = (fread(mEntries.data(), sizeof(TTimeIndexEntry), mEntries.size(), file) == mEntries.size());
+   }
+
+   fclose(file);
+
+   return status;
+}
+
+// Builds the index by walking the record headers of a .bin file
+bool CTimeIndex::Build(const std::string& BinFilename)
+{
+   TRecordFileHeader file_header = {};
+   FILE*             file = fopen(BinFilename.c_str(), "rb");
+   uint32_t          version;
+   uint64_t          offset;
+
+   if (!file)
+      return false;
+
+   if (fread(&file_header, sizeof(file_header), 1, file) != 1)
+      memset(&file_header, 0, sizeof(file_header));
+
+   version = GetRecordFileVersion(file_header);
+   offset = (version == RECORD_FILE_VERSION_V1) ? 0 : file_header.header_size;
+
+   Reset(offset);
+
+   while (fseeko(file, offset, SEEK_SET) == 0)
+   {
+      double   time;
+      uint64_t bytes;       // following the header
+      uint64_t header_size;
+      bool     seekable = true;
+
+      if (version == RECORD_FILE_VERSION_V1)
+      {
+         header_size = sizeof(double) + sizeof(uint64_t);
+
+         if (fread(&time, sizeof(time), 1, file) != 1 || fread(&bytes, sizeof(bytes), 1, file) != 1)
+            break;
+      }
+      else
+      {
+         TRecordHeader header;
+
+         header_size = sizeof(header);
+
+         if (fread(&header, sizeof(header), 1, file) != 1)
+            break;
+
+         time = header.time;
+         bytes = header.bytes;
+
+         if (version >= RECORD_FILE_VERSION_V3)
+         {
+            seekable = IsRecordSeekable(header);
+            bytes = GetRecordBodySize(header);
+         }
+      }
+
+      Add(time, offset, seekable);
+      offset += header_size + bytes;
+   }
+
+   fclose(file);
+
+   return true;
+}
+
+// Loads the sidecar index of a .bin file, building (and saving) it if there
+// is none or the recording changed since it was made
+bool CTimeIndex::LoadOrBuild(const std::string& BinFilename)
+{
+   struct stat info;
+   std::string filename = GetFilename(BinFilename);
+
+   if (stat(BinFilename.c_str(), &info) != 0)
+      return false;
+
+   if (Load(filename, info.st_size))
+      return true;
+
+   printf("Building time index %s\n", filename.c_str());
+
+   if (!Build(BinFilename))
+      return false;
+
+   if (!Save(filename, info.st_size))
+      printf("Warning: could not save %s, the index is only kept in memory\n", filename.c_str());
+
+   return true;
+}
+
+// Returns the offset of the last indexed record at or before Time.  Reading
+// forward from there reaches the first record at or after Time.
+uint64_t CTimeIndex::Find(double Time) const
+{
+   size_t low = 0;
+   size_t high = mEntries.size();
+
+   if (mEntries.empty() || Time <= mEntries[0].time)
+      return mDataOffset;
+
+   // find the first entry after Time, the one before it is the answer
+   while (low < high)
+   {
+      size_t mid = (low + high) / 2;
+
+      if (mEntries[mid].time <= Time)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return mEntries[low - 1].offset;
+}
@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Time Index
+//  Class:      C++ Header
+//  Filename:   TimeIndex.h
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//! \class CTimeIndex
+//! \brief Sparse time to file offset index for .bin recordings
+//!
+//! Holds one entry every INTERVAL seconds (or MAX_GAP bytes, whichever comes
+//! first) so playback can seek to a time by jumping to the entry before it
+//! and reading at most one interval forward.  Entries are only made at
+//! records that can be decoded on their own (not delta records).
+//!
+//! The index lives next to the recording as file_<ip>_<mc>.bin.idx.  The
+//! recorder writes it when it closes the file, and playback builds it on
+//! first open for recordings that do not have one (or whose size changed).
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static constexpr char     TIME_INDEX_MAGIC[8] = { 'U', 'D', 'P', 'T', 'I', 'X', 0, 0 };
+static constexpr uint32_t TIME_INDEX_VERSION  = 1;
+
+struct TTimeIndexHeader
+{
+   char     magic[8];    // TIME_INDEX_MAGIC
+   uint32_t version;     // TIME_INDEX_VERSION
+   uint32_t num_entries;
+   uint64_t file_size;   // size of the .bin file the index was built from
+   uint64_t data_offset; // offset of the first record
+   double   first_time;
+   double   last_time;
+};
+
+struct TTimeIndexEntry
+{
+   double   time;   // time of the record at offset
+   uint64_t offset;
+};
+
+class CTimeIndex
+{
+public:
+   static constexpr double   INTERVAL = 1.0;
+   static constexpr uint64_t MAX_GAP  = 4 * 1024 * 1024;
+
+   CTimeIndex();
+   ~CTimeIndex();
+
+   static std::string GetFilename(const std::string& BinFilename);
+
+   void Reset(uint64_t DataOffset);
+   void Add(double Time, uint64_t Offset, bool Seekable = true);
+   bool StartsEntry(double Time, uint64_t Offset) const;
+
+   bool Save(const std::string& Filename, uint64_t FileSize) const;
+   bool Load(const std::string& Filename, uint64_t FileSize);
+   bool Build(const std::string& BinFilename);
+   bool LoadOrBuild(const std::string& BinFilename);
+
+   uint64_t Find(double Time) const;
+
+   bool   IsEmpty() const { return mEntries.empty(); }
+   double GetFirstTime() const { return mFirstTime; }
+   double GetLastTime() const { return mLastTime; }
+
+private:
+   std::vector<TTimeIndexEntry> mEntries;
+   uint64_t                     mDataOffset;
+   double                       mFirstTime;
+   double                       mLastTime;
+};
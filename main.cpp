@@ -2,7 +2,11 @@
 #include <stdint.h>
 #include <signal.h>
 #include <stdlib.h>
-#include <mutex>
+#include <limits.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
 #include <thread>
 #include <fstream>
 #include <unordered_map>
@@ -11,14 +15,56 @@
 #include <algorithm>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <cmath>
 #include "SimTimer.h"
 #include "PrintData.h"
 #include "SimUdpSocket.h"
+#include "RecordFile.h"
+#include "PacketRing.h"
+#include "PacketArena.h"
+#include "IoUring.h"
+#include "RecordWriter.h"
+#include "Container.h"
+#include "BlackBox.h"
+#include "RecordReader.h"
+#include "PlaybackScheduler.h"
+#include "PlaybackPacer.h"
+#include "PlaybackTimeline.h"
+#include "RateLimiter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "PacketCapture.h"
+#include "PcapngReader.h"
+#include "PcapngExport.h"
+#include "PayloadStore.h"
+#include "DeltaCodec.h"
+#include "MappedFile.h"
+#include "TimeIndex.h"
 
 // unity build
 #include "SimTimer.cpp"
 #include "PrintData.cpp"
 #include "SimUdpSocket.cpp"
+#include "PacketArena.cpp"
+#include "IoUring.cpp"
+#include "RecordWriter.cpp"
+#include "Container.cpp"
+#include "BlackBox.cpp"
+#include "MappedFile.cpp"
+#include "RecordReader.cpp"
+#include "PlaybackScheduler.cpp"
+#include "PlaybackPacer.cpp"
+#include "PlaybackTimeline.cpp"
+#include "RateLimiter.cpp"
+#include "Logger.cpp"
+#include "Metrics.cpp"
+#include "PacketCapture.cpp"
+#include "PcapngReader.cpp"
+#include "PcapngExport.cpp"
+#include "PayloadStore.cpp"
+#include "DeltaCodec.cpp"
+#include "TimeIndex.cpp"
 
 const char* IP_ADDRESS       = "192.168.2.128";
 const char* MY_IP_ADDRESS    = "192.168.2.133";
@@ -27,6 +73,18 @@ const int   PORT             = 4000;
 const int   NUM_MC_ADDRESSES = 250;
 const int   MAX_BUFFER       = 65536;
 const bool  LOOP_PLAYBACK    = true;
+const int   TX_SOURCE_PORT   = 55432; // source port of played back traffic
+const int   TICK_PACKETS     = 1024;  // most packets gathered before checking for a stop
+const double MIN_SPEED       = 0.1;
+const double MAX_SPEED       = 100.0;
+const int   RING_SIZE        = 65536;
+const int   SLAB_SIZE        = 2 * 1024 * 1024;
+const int   NUM_SLABS        = 32;    // shared out between the receive threads
+const int   MIN_SLABS        = 8;     // per receive thread
+const int   SLOT_BYTES       = 2048;  // payload received straight into the arena, the rest spills
+const int   WRITE_QUEUE      = 64;    // writes in flight with the io_uring writer
+const int   WRITE_FLUSH_MS   = 20;    // longest a record waits to be coalesced
+const int   MAX_STREAMS      = 4096;  // streams with metrics
 
 // Set the following settings to ensure traffic is recorded
 // Also, make sure the PORT is allowed through the firewall
@@ -40,441 +98,2002 @@ const bool  LOOP_PLAYBACK    = true;
 //  echo "net.core.optmem_max=8388608" >> /etc/sysctl.conf
 //  echo "net.ipv4.igmp_max_memberships=1024" >> /etc/sysctl.conf
 
-struct TBuffer
+struct TPlaybackFile
 {
-   std::string from_ip;
-   std::string from_mc;
-   double      time;
-   uint64_t    bytes;
-   char        buffer[MAX_BUFFER];
+   std::string                   filename;  // .bin file, or the container or capture holding the stream
+   bool                          container;
+   std::shared_ptr<CPcapngIndex> pcapng;    // index of the capture holding the stream, NULL if none
+   uint32_t                      stream_id; // stream within the container or capture
+   uint64_t                      size = UINT64_MAX; // bytes of the container that are valid
+   std::string                   from_ip;
+   std::string                   from_mc;
 };
 
-struct TThreadData
+//! One playback sender thread and the streams it plays
+struct TPlaybackWorker
 {
-   std::vector<TBuffer> data;
-   std::mutex           thread_mutex;
-   int                  running;
+   int                                         id;
+   int                                         cpu;     // core to pin to, -1 for none
+   std::vector<TPlaybackFile>                  files;
+   std::vector<std::unique_ptr<CStreamReader>> readers;
+   std::vector<std::unique_ptr<CSimUdpSocket>> sockets;
+   std::vector<sockaddr_in>                    destinations;
+   std::vector<TStreamMetrics*>                metrics;  // per stream, may be NULL
+   CPlaybackScheduler                          scheduler;
+   CPlaybackPacer                              pacer;
+   CRateLimiter                                limiter;
+   CLatencyHistogram                           latency;  // schedule to send
+   std::atomic<uint64_t>                       packets;  // packets sent
+   std::atomic<uint64_t>                       bytes;    // payload bytes sent
+   std::atomic<bool>                           finished;
 };
 
-struct TPlaybackFile
+//! One receive thread: its socket takes a share of the groups, and its ring
+//! and arena carry the records to the writer.  Every packet of a stream
+//! arrives on the same shard, so streams stay in order.
+struct TReceiveShard
 {
-   std::string filename;
-   std::string from_ip;
-   std::string from_mc;
-};
+   int                         id;
+   int                         cpu;    // core to pin to, -1 for none
+   CPacketRing<TPacketRecord*> ring;
+   CPacketArena                arena;
 
-struct TPlaybackBuffer
-{
-   double   time;
-   uint64_t bytes;
-   char     buffer[MAX_BUFFER];
+   TReceiveShard(int Id, int Cpu, int NumSlabs)
+      : ring(RING_SIZE), arena(SLAB_SIZE, NumSlabs)
+   {
+      id = Id;
+      cpu = Cpu;
+   }
 };
 
-int         total_packets_recorded = 0;
-bool        playback_running = true;
-TThreadData thread_data;
+CLogger                       logger;
+std::atomic<uint64_t>         total_packets_recorded(0);
+std::atomic<uint64_t>         kernel_drops(0);           // dropped in the socket before recvmmsg saw them
+std::atomic<bool>             playback_running(true);
+std::atomic<bool>             record_running(true);
+std::vector<TReceiveShard*>   record_shards;             // never freed, the receive threads are not joined
+int                           num_record_threads = 1;
+std::vector<int>              record_cpus;
+eCaptureBackend               capture_backend = CAPTURE_SOCKET;
+std::string                   capture_interface;         // empty for the one that has MY_IP_ADDRESS
+eWriterBackend                writer_backend = WRITER_IO_URING;
+bool                          writer_direct = false;     // O_DIRECT with aligned blocks
+uint64_t                      sync_bytes = 0;            // fdatasync after this many bytes, 0 for never
+double                        sync_interval = 0.0;       // or after this many seconds, 0 for never
+bool                          record_container = false;
+double                        playback_start = 0.0;      // seconds into the recording, negative from the end
+double                        playback_end = HUGE_VAL;
+ePaceMode                     pace_mode = PACE_HYBRID;
+int                           num_tx_sockets = 1;
+int                           num_playback_threads = 1;
+std::string                   playback_hosts;            // "all" or a comma separated list, empty to ask
+std::vector<int>              playback_cpus;
+double                        playback_speed = 1.0;      // recorded seconds per wall clock second
+bool                          playback_fast = false;     // ignore recorded timing
+double                        playback_max_pps = 0.0;    // 0 for no cap
+double                        playback_max_bps = 0.0;
+int                           socket_rcvbuf = 0;         // bytes, 0 for the system default
+int                           socket_sndbuf = 0;
+std::string                   metrics_socket;            // Unix socket serving the metrics, empty for none
+std::string                   metrics_file;              // file the metrics are written to every second
+bool                          record_dedup = false;      // write repeated payloads as references
+bool                          record_delta = false;      // write payloads as deltas against the one before
+std::string                   export_file;               // pcapng capture to convert the recording to, empty to play it
+uint64_t                      blackbox_bytes = 0;        // rolling recording size, 0 to record everything
+uint64_t                      blackbox_segment_bytes = 64 * 1024 * 1024;
 
 void int_handler(int sig_number)
 {
    if (sig_number == SIGINT)
    {
-      thread_data.thread_mutex.lock();
-      thread_data.running = 0;
-      thread_data.thread_mutex.unlock();
+      record_running = false;
       playback_running = false;
+
+      // wake the writer so it sees the flag
+      if (!record_shards.empty())
+         record_shards[0]->ring.Wakeup();
    }
 }
 
-void playback(const char* Directory)
+// Adds every stream of a session container to Files, grouped by computer.
+// Only the first Size bytes are read, for a black box segment.
+bool add_container_streams(const std::string& Filename, std::unordered_map<std::string, std::vector<TPlaybackFile>>& Files,
+                           uint64_t Size = UINT64_MAX)
 {
-   std::unordered_map<std::string, std::vector<TPlaybackFile>> files;
+   CContainerIndex index;
+
+   if (!index.Load(Filename.c_str(), Size))
+      return false;
+
+   if (index.WasRecovered() && Size == UINT64_MAX)
+      printf("Warning: %s was not closed, recovered %ld chunks\n", Filename.c_str(), index.GetChunks().size());
+
+   for (const auto& stream : index.GetStreams())
+   {
+      TPlaybackFile file;
+      char          address[INET_ADDRSTRLEN] = {};
+
+      file.filename  = Filename;
+      file.container = true;
+      file.stream_id = stream.stream_id;
+      file.size      = Size;
+
+      inet_ntop(AF_INET, &stream.from_ip, address, sizeof(address));
+      file.from_ip = address;
+      inet_ntop(AF_INET, &stream.to_mcast_ip, address, sizeof(address));
+      file.from_mc = address;
+
+      Files[file.from_ip].emplace_back(file);
+   }
+
+   return true;
+}
+
+// Pins the calling thread to one core
+bool pin_thread(int Cpu)
+{
+   cpu_set_t cpus;
+
+   CPU_ZERO(&cpus);
+   CPU_SET(Cpu, &cpus);
+
+   return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+// Adds every UDP multicast stream of a pcapng capture to Files, grouped by
+// computer
+bool add_pcapng_streams(const std::string& Filename, std::unordered_map<std::string, std::vector<TPlaybackFile>>& Files)
+{
+   std::shared_ptr<CPcapngIndex> index(new CPcapngIndex);
+
+   printf("Indexing capture %s\n", Filename.c_str());
+
+   if (!index->Load(Filename.c_str(), PORT))
+      return false;
+
+   if (index->GetSkipped())
+      printf("Skipping %lu packets in %s that are not whole UDP multicast datagrams to port %d\n", index->GetSkipped(), Filename.c_str(), PORT);
+
+   for (const auto& stream : index->GetStreams())
+   {
+      TPlaybackFile file;
+      char          address[INET_ADDRSTRLEN] = {};
+
+      file.filename  = Filename;
+      file.container = false;
+      file.pcapng    = index;
+      file.stream_id = stream.stream_id;
+
+      inet_ntop(AF_INET, &stream.from_ip, address, sizeof(address));
+      file.from_ip = address;
+      inet_ntop(AF_INET, &stream.to_mcast_ip, address, sizeof(address));
+      file.from_mc = address;
 
-   printf("Playback from %s directory\n", Directory);
+      Files[file.from_ip].emplace_back(file);
+   }
+
+   return true;
+}
+
+// Plays the streams of one sender thread, paced against the shared timeline
+void playback_thread(TPlaybackWorker& Worker, CPlaybackTimeline& Timeline)
+{
+   CPlaybackScheduler& scheduler = Worker.scheduler;
+   CPlaybackPacer&     pacer = Worker.pacer;
+   double              start_time;
+   double              real_start_time;
+   TScheduledPacket    packet;
+
+   if (Worker.cpu >= 0 && !pin_thread(Worker.cpu))
+      logger.Log(LOG_WARNING, "could not pin playback thread %d to core %d", Worker.id, Worker.cpu);
+
+   struct TSendBatch
+   {
+      TUdpSendPacket packets[CSimUdpSocket::MAX_BATCH];
+      double         deadlines[CSimUdpSocket::MAX_BATCH];
+      int            streams[CSimUdpSocket::MAX_BATCH];
+      int            count = 0;
+   };
+
+   // a stream's payloads wait in one batch, plus the one the scheduler holds,
+   // and a decoded payload has to outlast them
+   static_assert(CBinFileReader::DECODE_DEPTH > CSimUdpSocket::MAX_BATCH + 1, "decode ring shorter than a send batch");
+
+   std::vector<TSendBatch> batches(Worker.sockets.size());
+
+   pacer.SetMode(pace_mode);
+
+   // Sends the packets gathered this tick for one socket with one sendmmsg
+   auto send_batch = [&](int k)
+   {
+      TSendBatch& batch = batches[k];
+
+      if (batch.count == 0)
+         return;
+
+      Worker.sockets[k]->SendBatch(batch.packets, batch.count);
+
+      double sent = CSimTimer::GetCurrentTime();
 
-   // Find all the .bin files in the folder and break them up by computer
-   std::filesystem::path directory_path = Directory;
+      uint64_t bytes = 0;
 
-   // Check if the directory exists
-   if (!std::filesystem::exists(directory_path) || !std::filesystem::is_directory(directory_path)) {
-      printf("Error: Directory '%s' not found or is not a directory\n", Directory);
+      for (int j = 0; j < batch.count; j++)
+      {
+         TStreamMetrics* metrics = Worker.metrics[batch.streams[j]];
+
+         if (!playback_fast)
+         {
+            pacer.AddSample(batch.deadlines[j], sent);
+            Worker.latency.Add(sent - batch.deadlines[j]);
+         }
+
+         if (metrics)
+            metrics->Count(batch.packets[j].bytes);
+
+         bytes += batch.packets[j].bytes;
+      }
+
+      // only this thread writes them
+      Worker.packets.store(Worker.packets.load(std::memory_order_relaxed) + batch.count, std::memory_order_relaxed);
+      Worker.bytes.store(Worker.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+      batch.count = 0;
+   };
+
+   scheduler.Start();
+
+   if (!Timeline.Sync(scheduler.IsDone() ? HUGE_VAL : scheduler.GetStartTime(), start_time, real_start_time))
+   {
+      Worker.finished = true;
       return;
    }
 
-   // Iterate through the directory entries
-   for (const auto& entry : std::filesystem::directory_iterator(directory_path))
+   if (Worker.id == 0)
+      logger.Log(LOG_INFO, "Start time %f", start_time);
+
+   while (playback_running)
+   {
+      if (scheduler.IsDone())
+      {
+         if (!LOOP_PLAYBACK)
+            break;
+
+         if (Worker.id == 0)
+            logger.Log(LOG_INFO, "Looping...");
+
+         // Reset all files, and wait for the other threads to finish theirs
+         scheduler.Start();
+
+         if (!Timeline.Sync(scheduler.IsDone() ? HUGE_VAL : scheduler.GetStartTime(), start_time, real_start_time))
+            break;
+
+         continue;
+      }
+
+      // Wait for the next packet to be due, unless going as fast as possible
+      if (!playback_fast)
+      {
+         double deadline = real_start_time + (scheduler.GetNextTime() - start_time) / playback_speed;
+
+         if (!pacer.WaitUntil(deadline))
+            continue;
+      }
+
+      double curr_time = CSimTimer::GetCurrentTime();
+      double next_time = playback_fast ? HUGE_VAL : start_time + (curr_time - real_start_time) * playback_speed;
+      int    num_due = 0;
+
+      // Send everything that is due, in recorded order across all streams.
+      // The tick is cut short after TICK_PACKETS so a stop is still seen when
+      // everything is due at once.
+      while (num_due < TICK_PACKETS && playback_running && scheduler.PopDue(next_time, packet))
+      {
+         int i = packet.stream;
+
+         num_due++;
+
+         logger.Log(LOG_PACKET, "Sending message to %s bytes %lu", Worker.files[i].from_mc.c_str(), packet.record.bytes);
+
+         // Hold the packet back while over the rate cap
+         if (Worker.limiter.IsLimited())
+         {
+            double send_time = Worker.limiter.Reserve(packet.record.bytes, curr_time);
+
+            if (send_time > curr_time)
+            {
+               for (int k = 0; k < Worker.sockets.size(); k++)
+                  send_batch(k);
+
+               while (playback_running && !pacer.WaitUntil(send_time))
+                  ;
+
+               curr_time = CSimTimer::GetCurrentTime();
+            }
+         }
+
+         int         k = i % Worker.sockets.size();
+         TSendBatch& batch = batches[k];
+
+         batch.packets[batch.count].buffer = packet.record.payload;
+         batch.packets[batch.count].bytes  = packet.record.bytes;
+         batch.packets[batch.count].to     = &Worker.destinations[i];
+         batch.streams[batch.count]        = i;
+         batch.deadlines[batch.count++]    = real_start_time + (packet.record.time - start_time) / playback_speed;
+
+         if (batch.count == CSimUdpSocket::MAX_BATCH)
+            send_batch(k);
+
+         if (packet.last)
+            logger.Log(LOG_INFO, "Finished sending data to %s", Worker.files[i].from_mc.c_str());
+      }
+
+      for (int k = 0; k < Worker.sockets.size(); k++)
+         send_batch(k);
+   }
+
+   Worker.finished = true;
+}
+
+// Finds the streams of a recording directory, session container or pcapng
+// capture, grouped by computer
+bool find_playback_files(const char* Path, std::unordered_map<std::string, std::vector<TPlaybackFile>>& Files)
+{
+   // A single file is a session container or a pcapng capture
+   if (std::filesystem::is_regular_file(Path))
+   {
+      printf("Reading %s\n", Path);
+
+      if (CContainerIndex::IsContainer(Path))
+      {
+         if (!add_container_streams(Path, Files))
+            return false;
+      }
+      else if (!CPcapngIndex::IsPcapng(Path) || !add_pcapng_streams(Path, Files))
+      {
+         printf("Error: '%s' is not a session container or pcapng capture\n", Path);
+         return false;
+      }
+   }
+   else
    {
-      if (std::filesystem::is_regular_file(entry.status()))
+      printf("Reading %s directory\n", Path);
+
+      // Find all the .bin files in the folder and break them up by computer
+      std::filesystem::path directory_path = Path;
+
+      // Check if the directory exists
+      if (!std::filesystem::exists(directory_path) || !std::filesystem::is_directory(directory_path)) {
+         printf("Error: Directory '%s' not found or is not a directory\n", Path);
+         return false;
+      }
+
+      // A black box lists its segments and how much of each is valid
+      std::vector<TBlackBoxSegment> segments;
+
+      if (CBlackBox::LoadManifest(Path, segments))
       {
-         std::string file_extension = entry.path().extension().string();
+         printf("Reading black box, %ld segments\n", segments.size());
 
-         if (file_extension == ".bin")
+         for (const auto& segment : segments)
          {
-            TPlaybackFile file;
-            bool          found = true;
+            if (segment.bytes > 0)
+               add_container_streams(segment.filename, Files, segment.bytes);
+         }
+      }
 
-            file.filename = entry.path().filename().string();
+      // Iterate through the directory entries.  Pcapng captures are left out,
+      // their times are epoch rather than CLOCK_MONOTONIC so they can only be
+      // played on their own.
+      for (const auto& entry : std::filesystem::directory_iterator(directory_path))
+      {
+         if (std::filesystem::is_regular_file(entry.status()))
+         {
+            std::string file_extension = entry.path().extension().string();
 
-            size_t pos = file.filename.find("_");
-            if (pos != std::string::npos)
+            if (file_extension == ".urec")
             {
-               file.from_ip = file.filename.substr(pos + 1, file.filename.length() - pos + 1);
+               add_container_streams(entry.path().string(), Files);
+            }
+            else if (file_extension == ".bin")
+            {
+               TPlaybackFile file;
+               bool          found = true;
 
-               pos = file.from_ip.find("_");
+               file.filename = entry.path().filename().string();
+
+               size_t pos = file.filename.find("_");
                if (pos != std::string::npos)
                {
-                  file.from_mc = file.from_ip.substr(pos + 1, file.from_ip.length() - pos - 5);
-                  file.from_ip = file.from_ip.substr(0, pos);
+                  file.from_ip = file.filename.substr(pos + 1, file.filename.length() - pos + 1);
+
+                  pos = file.from_ip.find("_");
+                  if (pos != std::string::npos)
+                  {
+                     file.from_mc = file.from_ip.substr(pos + 1, file.from_ip.length() - pos - 5);
+                     file.from_ip = file.from_ip.substr(0, pos);
+                  }
+                  else
+                  {
+                     found = false;
+                  }
                }
                else
                {
                   found = false;
                }
-            }
-            else
-            {
-               found = false;
-            }
 
-            if (!found)
-               continue;
+               if (!found)
+                  continue;
 
-            files[file.from_ip].emplace_back(file);
+               file.filename  = entry.path().string();
+               file.container = false;
+               file.stream_id = 0;
+               Files[file.from_ip].emplace_back(file);
+            }
          }
       }
    }
 
-   // Give the list of computers to the user, and let them choose one to playback
-   printf("\nList of computers to playback:\n");
+   return true;
+}
 
+// Picks the computers to play back from --hosts, or asks for one
+bool choose_hosts(const std::unordered_map<std::string, std::vector<TPlaybackFile>>& Files, std::vector<std::string>& Hosts)
+{
    std::vector<std::string> file_list;
 
-   for (const auto& file : files)
+   for (const auto& file : Files)
    {
       file_list.push_back(file.first);
    }
 
    std::sort(file_list.begin(), file_list.end());
 
-   for (int i = 0; i < file_list.size(); i++)
+   if (playback_hosts.empty())
+   {
+      // Give the list of computers to the user, and let them choose one to playback
+      printf("\nList of computers to playback:\n");
+
+      for (int i = 0; i < file_list.size(); i++)
+      {
+         printf(" %d) %s\n", i + 1, file_list[i].c_str());
+      }
+
+      printf("\nWhich computer to play back:\n");
+      fflush(stdout);
+
+      int index = 0;
+
+      std::cin >> index;
+
+      if (index > 0 && index <= file_list.size())
+      {
+         index--;
+         printf("Playing back computer %s\n", file_list[index].c_str());
+         Hosts.push_back(file_list[index]);
+      }
+      else
+      {
+         printf("Error: invalid selection\n");
+         return false;
+      }
+   }
+   else if (playback_hosts == "all")
    {
-      printf(" %d) %s\n", i + 1, file_list[i].c_str());
+      Hosts = file_list;
    }
+   else
+   {
+      std::stringstream list(playback_hosts);
+      std::string       host;
+
+      while (std::getline(list, host, ','))
+      {
+         if (Files.find(host) == Files.end())
+         {
+            printf("Error: no recording from %s\n", host.c_str());
+            return false;
+         }
 
-   printf("\nWhich computer to play back:\n");
+         Hosts.push_back(host);
+      }
+   }
 
-   int index = 0;
+   return true;
+}
 
-   std::cin >> index;
+// Opens the reader of one stream, which reads nothing if the file is bad
+std::unique_ptr<CStreamReader> open_stream_reader(const TPlaybackFile& File)
+{
+   if (File.pcapng)
+   {
+      std::unique_ptr<CPcapngStreamReader> reader(new CPcapngStreamReader);
 
-   if (index)
+      printf("Opening stream %s:%s in %s\n", File.from_ip.c_str(), File.from_mc.c_str(), File.filename.c_str());
+      reader->Open(*File.pcapng, File.stream_id);
+      return reader;
+   }
+   else if (File.container)
    {
-      index--;
-      printf("Playing back computer %s\n", file_list[index].c_str());
+      CContainerIndex                         container;
+      std::unique_ptr<CContainerStreamReader> reader(new CContainerStreamReader);
+
+      printf("Opening stream %s:%s in %s\n", File.from_ip.c_str(), File.from_mc.c_str(), File.filename.c_str());
+      if (container.Load(File.filename.c_str(), File.size))
+         reader->Open(container, File.stream_id);
+      return reader;
    }
    else
    {
-      printf("Error: invalid selection\n");
-      return;
+      std::unique_ptr<CBinFileReader> reader(new CBinFileReader);
+
+      printf("Opening file %s\n", File.filename.c_str());
+      reader->Open(File.filename.c_str());
+      return reader;
    }
+}
 
-   // Playback data
-   // 1. Create a socket for each multicast address
-   // 2. Initialize time to the earliest time out of all the files
-   // 3. Playback data until done
-   // 4. Loop if needed (or exit)
+void playback(const char* Path)
+{
+   std::unordered_map<std::string, std::vector<TPlaybackFile>> files;
+   std::vector<std::string>                                    hosts;
+
+   if (!find_playback_files(Path, files) || !choose_hosts(files, hosts))
+      return;
 
-   std::vector<std::ifstream>   input_files;
-   std::vector<CSimUdpSocket*>  sockets;
-   std::vector<TPlaybackBuffer> buffers;
-   double                       start_time = 0.0;
+   // Playback data
+   // 1. Spread the streams of the chosen computers over the sender threads
+   // 2. Open the streams and the transmit sockets of each thread
+   // 3. Start every thread on one timeline at the earliest time of all files
+   // 4. Playback data until done, looping in step if needed
 
-   const auto& playback_files = files[file_list[index]];
+   std::vector<TPlaybackFile> playback_files;
 
-   for (int i = 0; i < playback_files.size(); i++)
+   for (const auto& host : hosts)
    {
-      TPlaybackBuffer buffer;
-      std::string     filename = Directory;
-      filename += "/";
-      filename += playback_files[i].filename;
-                     
-      printf("Opening file %s\n", filename.c_str());
-      std::ifstream input_file(filename, std::ios::binary);
+      printf("Playing back computer %s (%ld streams)\n", host.c_str(), files[host].size());
+      playback_files.insert(playback_files.end(), files[host].begin(), files[host].end());
+   }
+
+   int                                          num_workers = std::min<int>(num_playback_threads, playback_files.size());
+   int                                          num_cpus = std::thread::hardware_concurrency();
+   std::vector<std::unique_ptr<TPlaybackWorker>> workers;
+   CStreamMetricsTable                          stream_metrics(MAX_STREAMS);
+   CMetricsServer                               metrics;
 
-      // Read first buffer out of each file
-      input_file.read((char*)&buffer.time, sizeof(buffer.time));
-      input_file.read((char*)&buffer.bytes, sizeof(buffer.bytes));
-      input_file.read(buffer.buffer, buffer.bytes);
+   for (int k = 0; k < num_workers; k++)
+   {
+      std::unique_ptr<TPlaybackWorker> worker(new TPlaybackWorker);
 
-      if (buffer.time < start_time || start_time == 0.0)
-         start_time = buffer.time;
+      worker->id = k;
+      worker->packets = 0;
+      worker->bytes = 0;
+      worker->finished = false;
 
-      input_files.push_back(std::move(input_file));
-      buffers.emplace_back(buffer);
+      // the rate cap is shared evenly between the threads
+      worker->limiter.SetRate(playback_max_pps / num_workers, playback_max_bps / num_workers);
 
-      printf("Opening socket %s:%d\n", playback_files[i].from_mc.c_str(), PORT);
-      CSimUdpSocket* socket = new CSimUdpSocket();
-      socket->Open(playback_files[i].from_mc.c_str(), PORT, 55432);
-      socket->SetMultiCast(MY_IP_ADDRESS);
-      socket->JoinMcastGroup(playback_files[i].from_mc.c_str(), MY_IP_ADDRESS);
-      socket->SetTtl(32);
+      // only pin when asked for cores or when there are several threads
+      if (!playback_cpus.empty())
+         worker->cpu = playback_cpus[k % playback_cpus.size()];
+      else if (num_workers > 1 && num_cpus > 0)
+         worker->cpu = k % num_cpus;
+      else
+         worker->cpu = -1;
 
-      sockets.push_back(socket);
+      workers.push_back(std::move(worker));
    }
 
-   printf("\nStart time %f\n", start_time);
+   for (int i = 0; i < playback_files.size(); i++)
+      workers[i % num_workers]->files.push_back(playback_files[i]);
 
-   double next_playback_time = start_time;
-   double real_start_time = CSimTimer::GetCurrentTime();
-   char   time_str[50] = {};
+   double first_time = HUGE_VAL;
+   double last_time = -HUGE_VAL;
 
-   while (playback_running)
+   for (auto& worker : workers)
    {
-      double curr_time = CSimTimer::GetCurrentTime();
-      double delta = curr_time - real_start_time;
-      double next_time = start_time + delta;
+      TPlaybackWorker& w = *worker;
 
-      // Check if playback is still running
-      bool all_zeros = true;
-      for (int i = 0; i < buffers.size(); i++)
+      // Streams are spread over a few send-only sockets, each message carries
+      // its group address so nothing is joined on the transmit side
+      for (int i = 0; i < num_tx_sockets; i++)
       {
-         if (buffers[i].bytes > 0)
-         {
-            all_zeros = false;
-            break;
-         }
+         std::unique_ptr<CSimUdpSocket> socket(new CSimUdpSocket);
+
+         if (!socket->OpenSend(BASE_MC_ADDRESS, PORT, TX_SOURCE_PORT))
+            return;
+
+         socket->SetMultiCast(MY_IP_ADDRESS);
+         socket->SetTtl(32);
+
+         if (socket_sndbuf > 0 && socket->SetSendBuffer(socket_sndbuf) < 2 * socket_sndbuf)
+            printf("Warning: send buffer capped below %d bytes, raise net.core.wmem_max or run as root\n", socket_sndbuf);
+
+         w.sockets.push_back(std::move(socket));
       }
 
-      if (all_zeros)
+      for (int i = 0; i < w.files.size(); i++)
       {
-         if (LOOP_PLAYBACK)
-         {
-            CSimTimer::GetCurrentTimeStr(time_str);
-            printf("\n%s: Looping...\n\n", time_str);
+         w.readers.push_back(open_stream_reader(w.files[i]));
+         w.scheduler.AddStream(w.readers[i].get());
 
-            start_time = 0.0;
+         sockaddr_in destination = {};
 
-            // Reset all files
-            buffers.clear();
-            for (int i = 0; i < playback_files.size(); i++)
-            {
-               TPlaybackBuffer buffer;
-               std::string     filename = Directory;
-               filename += "/";
-               filename += playback_files[i].filename;
-                              
-               input_files[i].clear();
-               input_files[i].seekg(0, std::ios::beg);
-
-               // Read first buffer out of each file
-               input_files[i].read((char*)&buffer.time, sizeof(buffer.time));
-               input_files[i].read((char*)&buffer.bytes, sizeof(buffer.bytes));
-               input_files[i].read(buffer.buffer, buffer.bytes);
-
-               if (buffer.time < start_time || start_time == 0.0)
-                  start_time = buffer.time;
-
-               buffers.emplace_back(buffer);
-            }
+         destination.sin_family = AF_INET;
+         destination.sin_port = htons(PORT);
+         inet_pton(AF_INET, w.files[i].from_mc.c_str(), &destination.sin_addr);
+         w.destinations.push_back(destination);
 
-            next_playback_time = start_time;
-            real_start_time = CSimTimer::GetCurrentTime();
-         }
-         else
-         {
-            break;
-         }
+         // only this worker counts into its entries
+         struct in_addr from_ip = {};
+
+         inet_pton(AF_INET, w.files[i].from_ip.c_str(), &from_ip);
+         w.metrics.push_back(stream_metrics.Add(from_ip, destination.sin_addr));
       }
 
-      // Look over playback buffers and see if it's time to send
-      for (int i = 0; i < buffers.size(); i++)
+      double first;
+      double last;
+
+      if (w.scheduler.GetTimeRange(first, last))
       {
-         if (next_time >= buffers[i].time && buffers[i].bytes > 0)
-         {
-            CSimTimer::GetCurrentTimeStr(time_str);
-            printf("%s: Sending message to %s bytes %d\n", time_str, playback_files[i].from_mc.c_str(), buffers[i].bytes);
-            total_packets_recorded++;
-            sockets[i]->SendToSocket(buffers[i].buffer, buffers[i].bytes);
+         first_time = std::min(first_time, first);
+         last_time = std::max(last_time, last);
+      }
+   }
 
-            if (!input_files[i].eof())
-            {
-               input_files[i].read((char*)&buffers[i].time, sizeof(buffers[i].time));
-               input_files[i].read((char*)&buffers[i].bytes, sizeof(buffers[i].bytes));
-               input_files[i].read(buffers[i].buffer, buffers[i].bytes);
-            }
+   // Convert the requested window to recording times, negative values count
+   // back from the end
+   if (first_time <= last_time)
+   {
+      double seek_time = (playback_start < 0.0) ? last_time + playback_start : first_time + playback_start;
+      double end_time = HUGE_VAL;
 
-            if (input_files[i].eof())
-            {
-               printf("Finished sending data to %s\n", playback_files[i].from_mc.c_str());
-               buffers[i].bytes = 0;
-            }
-         }
-      }
+      if (playback_end != HUGE_VAL)
+         end_time = (playback_end < 0.0) ? last_time + playback_end : first_time + playback_end;
+
+      for (auto& worker : workers)
+         worker->scheduler.SetWindow(seek_time, end_time);
 
-      usleep(500);
+      printf("\nRecording %f to %f, playing %f to %f\n", first_time, last_time, seek_time, std::min(end_time, last_time));
    }
 
-   printf("%d packets played back\n", total_packets_recorded);
-   printf("\nExiting...\n");
-}
+   printf("\nPlaying %ld streams on %d thread(s), %d transmit socket(s) each\n", playback_files.size(), num_workers, num_tx_sockets);
 
-void record_thread()
-{
-   CSimUdpSocket socket;
-   char          time_str[50] = {};
-   in_addr_t     mc_addr_t    = inet_addr(BASE_MC_ADDRESS);
-   char          buffer[MAX_BUFFER];
-   bool          running = true;
+   if (playback_fast)
+      printf("Sending as fast as possible\n");
+   else if (playback_speed != 1.0)
+      printf("Speed %gx\n", playback_speed);
 
-   socket.Open(IP_ADDRESS, PORT, PORT);
+   if (playback_max_pps > 0.0 || playback_max_bps > 0.0)
+      printf("Rate capped at %.0f packets/s, %.0f bits/s (0 is no cap)\n", playback_max_pps, playback_max_bps);
 
-   socket.SetMultiCast(MY_IP_ADDRESS);
-   for (int i = 0; i < NUM_MC_ADDRESSES; i++)
-   {
-      in_addr  mc_addr;
-      uint32_t offset = (i + 1) << 24;
-      char*    mc_address;
+   CPlaybackTimeline        timeline(num_workers, playback_running);
+   std::vector<std::thread> threads;
 
-      mc_addr.s_addr = mc_addr_t + offset;
-      mc_address = inet_ntoa(mc_addr);
+   double send_start = CSimTimer::GetCurrentTime();
 
-      socket.JoinMcastGroup(mc_address, MY_IP_ADDRESS);
-   }
+   for (auto& worker : workers)
+      threads.emplace_back(playback_thread, std::ref(*worker), std::ref(timeline));
 
-   while (running)
+   auto format_metrics = [&](std::string& text, double now)
    {
-      char from_ip[INET_ADDRSTRLEN] = {};
-      char from_mc[INET_ADDRSTRLEN] = {};
-      int  bytes = 0;
-
-      bytes = socket.ReceiveFromSocket(buffer, MAX_BUFFER, from_ip, from_mc);
+      TLatencySnapshot latency;
+      uint64_t         packets = 0;
+      uint64_t         bytes = 0;
+      int              running = 0;
 
-      if (bytes > 0)
+      for (auto& worker : workers)
       {
-         CSimTimer::GetCurrentTimeStr(time_str);
-         printf("%s: Got message from %s (%s) bytes %d\n", time_str, from_ip, from_mc, bytes);
-         total_packets_recorded++;
+         packets += worker->packets.load(std::memory_order_relaxed);
+         bytes += worker->bytes.load(std::memory_order_relaxed);
+         running += !worker->finished;
+         latency.Add(worker->latency);
       }
 
-      thread_data.thread_mutex.lock();
+      AppendMetric(text, "mode playback\n");
+      AppendMetric(text, "uptime_s %.1f\n", now - send_start);
+      AppendMetric(text, "threads %d\n", num_workers);
+      AppendMetric(text, "threads_running %d\n", running);
+      AppendMetric(text, "packets_total %lu\n", packets);
+      AppendMetric(text, "bytes_total %lu\n", bytes);
+
+      for (auto& worker : workers)
+         AppendMetric(text, "thread %d packets %lu bytes %lu\n", worker->id,
+            worker->packets.load(std::memory_order_relaxed), worker->bytes.load(std::memory_order_relaxed));
+
+      latency.Format(text, "schedule_to_send");
+      stream_metrics.Format(text, now);
+   };
+
+   if (!metrics_socket.empty() || !metrics_file.empty())
+      metrics.Open(metrics_socket, metrics_file, format_metrics);
+
+   // Summarize once a second until every thread is done
+   double   last_summary = send_start;
+   uint64_t last_packets = 0;
+   uint64_t last_bytes = 0;
+
+   while (true)
+   {
+      bool running = false;
+
+      for (auto& worker : workers)
+         running |= !worker->finished;
+
+      if (!running)
+         break;
 
-      running = thread_data.running;
+      usleep(100000);
 
-      if (bytes > 0)
+      double now = CSimTimer::GetCurrentTime();
+
+      if (now - last_summary >= 1.0)
       {
-         TBuffer data;
+         uint64_t packets = 0;
+         uint64_t bytes = 0;
+
+         for (auto& worker : workers)
+         {
+            packets += worker->packets.load(std::memory_order_relaxed);
+            bytes += worker->bytes.load(std::memory_order_relaxed);
+         }
 
-         data.from_ip = from_ip;
-         data.from_mc = from_mc;
-         data.bytes   = bytes;
-         data.time    = CSimTimer::GetCurrentTime();
-         memcpy(data.buffer, buffer, bytes);
+         logger.Log(LOG_INFO, "Sent %lu packets, %.2f Mbit/s", packets - last_packets, (bytes - last_bytes) * 8.0 / (now - last_summary) / 1e6);
 
-         thread_data.data.emplace_back(data);
+         last_summary = now;
+         last_packets = packets;
+         last_bytes = bytes;
       }
+   }
+
+   for (auto& thread : threads)
+      thread.join();
 
-      thread_data.thread_mutex.unlock();
+   metrics.Close();
+   logger.Stop();
+
+   double         elapsed = CSimTimer::GetCurrentTime() - send_start;
+   uint64_t       total_bytes = 0;
+   CPlaybackPacer pacer;
+
+   pacer.SetMode(pace_mode);
+
+   for (auto& worker : workers)
+   {
+      total_packets_recorded += worker->packets;
+      total_bytes += worker->bytes;
+      pacer.Merge(worker->pacer);
    }
+
+   printf("%lu packets played back\n", total_packets_recorded.load());
+
+   if (elapsed > 0.0)
+      printf("Sent %lu bytes in %.3f s: %.0f packets/s, %.2f Mbit/s\n", total_bytes, elapsed,
+         total_packets_recorded.load() / elapsed, total_bytes * 8.0 / elapsed / 1e6);
+
+   pacer.PrintStats();
+   printf("\nExiting...\n");
 }
 
-int main(int argc, char* argv[])
+// Writes the streams of a recording to one pcapng capture, in time order
+void export_pcapng(const char* Path)
 {
-   char time_str[50] = {};
-   bool record = (argc == 1);
+   std::unordered_map<std::string, std::vector<TPlaybackFile>> files;
+   std::vector<std::string>                                    hosts;
+   std::vector<std::unique_ptr<CStreamReader>>                 readers;
+   CPcapngExporter                                             exporter;
+   int                                                         num_threads = std::thread::hardware_concurrency();
+   double                                                      first_time;
+   double                                                      last_time;
+
+   // every computer unless some were asked for
+   if (playback_hosts.empty())
+      playback_hosts = "all";
+
+   if (!find_playback_files(Path, files) || !choose_hosts(files, hosts))
+      return;
 
-   if (argc > 2)
+   for (const auto& host : hosts)
    {
-      printf("Usage: main [playback directory]\n");
-      return 1;
-   }
+      for (const auto& file : files[host])
+      {
+         struct in_addr from_ip = {};
+         struct in_addr to_mcast_ip = {};
 
-   // disable buffering
-   setvbuf(stdout, NULL, _IONBF, 0);
+         inet_pton(AF_INET, file.from_ip.c_str(), &from_ip);
+         inet_pton(AF_INET, file.from_mc.c_str(), &to_mcast_ip);
 
-   signal(SIGINT, int_handler);
+         readers.push_back(open_stream_reader(file));
+         exporter.AddStream(readers.back().get(), from_ip, to_mcast_ip);
+      }
+   }
 
-   thread_data.data.clear();
-   thread_data.running = 1;
+   exporter.SetPorts(TX_SOURCE_PORT, PORT);
 
-   if (record)
+   // same window as playback, negative values count back from the end
+   if (exporter.GetTimeRange(first_time, last_time))
    {
-      std::vector<TBuffer> local_data;
-      std::thread          record(record_thread);
-      bool                 running = true;
-      int                  prev_count = 0;
+      double start_time = (playback_start < 0.0) ? last_time + playback_start : first_time + playback_start;
+      double end_time = HUGE_VAL;
 
-      // make hash map to store file streams
-      std::unordered_map<std::string, std::ofstream> streams;
+      if (playback_end != HUGE_VAL)
+         end_time = (playback_end < 0.0) ? last_time + playback_end : first_time + playback_end;
 
-      CSimTimer::GetCurrentTimeStr(time_str);
-      printf("%s: Recording traffic on %s:%d, from .1-.%d\n", time_str, BASE_MC_ADDRESS, PORT, NUM_MC_ADDRESSES);
+      exporter.SetWindow(start_time, end_time);
 
-      while (running)
-      {
-         thread_data.thread_mutex.lock();
+      printf("\nRecording %f to %f, exporting %f to %f\n", first_time, last_time, start_time, std::min(end_time, last_time));
+   }
 
-         running = thread_data.running;
+   // one core is left for the merge
+   num_threads = std::max(1, num_threads - 1);
 
-         if (thread_data.data.size() > 0)
-         {
-            for (int i = 0; i < thread_data.data.size(); i++)
-            {
-               TBuffer data;
+   printf("Exporting %ld streams to %s with %d decode thread(s)\n", readers.size(), export_file.c_str(),
+      std::min<int>(num_threads, readers.size()));
 
-               data.from_ip = thread_data.data[i].from_ip;
-               data.from_mc = thread_data.data[i].from_mc;
-               data.bytes   = thread_data.data[i].bytes;
-               data.time    = thread_data.data[i].time;
-               memcpy(data.buffer, thread_data.data[i].buffer, data.bytes);
+   double start = CSimTimer::GetCurrentTime();
+   bool   status = exporter.Export(export_file.c_str(), num_threads, playback_running);
+   double elapsed = CSimTimer::GetCurrentTime() - start;
 
-               local_data.emplace_back(data);
-            }
+   if (exporter.GetSkipped())
+      printf("Skipped %lu records too big for a UDP datagram\n", exporter.GetSkipped());
 
-            thread_data.data.clear();
-         }
+   printf("%s %lu packets, %lu bytes", status ? "Exported" : "Error: export stopped after", exporter.GetPackets(),
+      exporter.GetBytesWritten());
 
-         thread_data.thread_mutex.unlock();
+   if (elapsed > 0.0)
+      printf(" in %.3f s: %.0f packets/s, %.1f MB/s", elapsed, exporter.GetPackets() / elapsed,
+         exporter.GetBytesWritten() / elapsed / 1e6);
 
-         for (int i = 0; i < local_data.size(); i++)
-         {
-            if (local_data[i].bytes > 0)
-            {
-               std::string filename = "file_";
-               filename += local_data[i].from_ip;
-               filename += "_";
-               filename += local_data[i].from_mc;
-               filename += ".bin";
+   printf("\n");
+}
 
-               if (streams.find(filename) == streams.end())
+// Receives the groups of one shard into its arena and hands them to the
+// writer through its ring
+void record_thread(TReceiveShard& Shard)
+{
+   CSimUdpSocket                socket;
+   CPacketCapture               capture;
+   bool                         use_capture = (capture_backend == CAPTURE_PACKET);
+   std::string                  interface = capture_interface;
+   in_addr_t                    mc_addr_t    = inet_addr(BASE_MC_ADDRESS);
+   std::vector<char>            large_buffer(CSimUdpSocket::MAX_BATCH * MAX_BUFFER);
+   TUdpPacket                   packets[CSimUdpSocket::MAX_BATCH];
+   TPacketRecord*               records[CSimUdpSocket::MAX_BATCH];
+   CPacketRing<TPacketRecord*>& ring  = Shard.ring;
+   CPacketArena&                arena = Shard.arena;
+   const size_t                 cell  = CPacketArena::RecordSize(SLOT_BYTES);
+   int                          num_shards = record_shards.size();
+   int                          num_groups = 0;
+   uint32_t                     prev_drops = 0;
+
+   if (Shard.cpu >= 0 && !pin_thread(Shard.cpu))
+      logger.Log(LOG_WARNING, "could not pin receive thread %d to core %d", Shard.id, Shard.cpu);
+
+   if (use_capture)
+   {
+      if (interface.empty() && !CPacketCapture::FindInterface(MY_IP_ADDRESS, interface))
+         printf("Error: no interface has address %s\n", MY_IP_ADDRESS);
+
+      // the capture threads split the traffic by flow
+      if (interface.empty() || !capture.Open(interface.c_str(), PORT, BASE_MC_ADDRESS, 24, num_shards > 1 ? getpid() & 0xffff : 0))
+      {
+         printf("Error: could not capture on '%s', packet capture needs CAP_NET_RAW\n", interface.c_str());
+         record_running = false;
+         Shard.ring.Wakeup();
+         return;
+      }
+
+      // the socket only joins the groups, bound to a port of its own it
+      // never receives any of them
+      socket.Open(IP_ADDRESS, PORT, 0);
+   }
+   else
+   {
+      // every shard binds the port, unicast traffic is spread over them by flow
+      socket.SetReusePort(num_shards > 1);
+      socket.Open(IP_ADDRESS, PORT, PORT);
+   }
+
+   if (socket_rcvbuf > 0 && !use_capture)
+   {
+      // the kernel reports twice the request, the rest is its bookkeeping
+      if (socket.SetReceiveBuffer(socket_rcvbuf) < 2 * socket_rcvbuf)
+         printf("Warning: receive buffer capped below %d bytes, raise net.core.rmem_max or run as root\n", socket_rcvbuf);
+   }
+
+   socket.SetMultiCast(MY_IP_ADDRESS);
+   socket.EnableTimestamps();
+   socket.EnableDropCounter();
+
+   // each shard only hears the groups it joined
+   if (num_shards > 1)
+      socket.SetMulticastAll(false);
+
+   for (int i = 0; i < NUM_MC_ADDRESSES; i++)
+   {
+      in_addr  mc_addr;
+      uint32_t offset = (i + 1) << 24;
+      char*    mc_address;
+
+      if (i % num_shards != Shard.id)
+         continue;
+
+      mc_addr.s_addr = mc_addr_t + offset;
+      mc_address = inet_ntoa(mc_addr);
+
+      socket.JoinMcastGroup(mc_address, MY_IP_ADDRESS);
+      num_groups++;
+   }
+
+   if (use_capture)
+      printf("Receive thread %d: capturing on %s, %d groups joined, core %d\n", Shard.id, interface.c_str(), num_groups, Shard.cpu);
+   else
+      printf("Receive thread %d: %d groups, core %d, receive buffer %d bytes (as reported by the kernel)\n",
+         Shard.id, num_groups, Shard.cpu, socket.GetReceiveBuffer());
+
+   while (record_running)
+   {
+      char     from_ip[INET_ADDRSTRLEN] = {};
+      char     from_mc[INET_ADDRSTRLEN] = {};
+      uint32_t num_slots = ring.WriteAvailable();
+      char*    region = nullptr;
+      int      num_packets = 0;
+
+      if (num_slots > CSimUdpSocket::MAX_BATCH)
+         num_slots = CSimUdpSocket::MAX_BATCH;
+
+      if (num_slots > 0)
+         region = arena.Reserve(num_slots * cell);
+
+      // Each datagram is received straight into a record sized cell in the
+      // arena. Anything bigger than SLOT_BYTES spills into large_buffer and is
+      // copied into the arena afterwards. If the writer has fallen behind and
+      // there is no room, keep draining the socket and count what was lost.
+      if (region)
+      {
+         for (uint32_t i = 0; i < num_slots; i++)
+         {
+            packets[i].buffer      = ((TPacketRecord*)(region + i * cell))->Payload();
+            packets[i].max_bytes   = SLOT_BYTES;
+            packets[i].spill       = &large_buffer[i * MAX_BUFFER + SLOT_BYTES];
+            packets[i].spill_bytes = MAX_BUFFER - SLOT_BYTES;
+         }
+      }
+      else
+      {
+         num_slots = CSimUdpSocket::MAX_BATCH;
+
+         for (uint32_t i = 0; i < num_slots; i++)
+         {
+            packets[i].buffer      = &large_buffer[i * MAX_BUFFER];
+            packets[i].max_bytes   = MAX_BUFFER;
+            packets[i].spill       = NULL;
+            packets[i].spill_bytes = 0;
+         }
+      }
+
+      num_packets = use_capture ? capture.ReceiveBatch(packets, num_slots) : socket.ReceiveBatch(packets, num_slots);
+
+      if (num_packets <= 0)
+         continue;
+
+      // the kernel's count only ever grows (and wraps), add what is new
+      uint32_t drops = use_capture ? capture.GetKernelDrops() : socket.GetKernelDrops();
+
+      if (drops != prev_drops)
+      {
+         kernel_drops.fetch_add((uint32_t)(drops - prev_drops), std::memory_order_relaxed);
+         prev_drops = drops;
+      }
+
+      if (!region)
+      {
+         ring.AddOverflows(num_packets);
+         continue;
+      }
+
+      // Take both clocks right after the receive. The kernel stamp is
+      // CLOCK_REALTIME, the monotonic time is found by backing the packet's
+      // age in the socket queue off of the current monotonic time.
+      TRecordHeader headers[CSimUdpSocket::MAX_BATCH];
+      double        mono_now = CSimTimer::GetCurrentTime();
+      double        real_now = CSimTimer::GetRealTime();
+      size_t        used = 0;
+      uint32_t      num_records = 0;
+
+      // Pack the records down so each one takes exactly header + payload
+      for (int i = 0; i < num_packets; i++)
+      {
+         if (packets[i].rx_time.tv_sec != 0)
+         {
+            headers[i].real_time = (double)packets[i].rx_time.tv_sec + (double)packets[i].rx_time.tv_nsec / 1000000000.0;
+            headers[i].time      = mono_now - (real_now - headers[i].real_time);
+         }
+         else
+         {
+            headers[i].real_time = real_now;
+            headers[i].time      = mono_now;
+         }
+         headers[i].bytes = packets[i].bytes;
+
+         if (packets[i].bytes > SLOT_BYTES)
+         {
+            // pull the part that landed in the arena in front of the spill so
+            // the whole payload is contiguous, it gets its own record below
+            memcpy(&large_buffer[i * MAX_BUFFER], packets[i].buffer, SLOT_BYTES);
+            records[i] = nullptr;
+         }
+         else
+         {
+            TPacketRecord* record = (TPacketRecord*)(region + used);
+
+            if (record->Payload() != packets[i].buffer)
+               memmove(record->Payload(), packets[i].buffer, packets[i].bytes);
+
+            record->slab        = arena.CurrentSlab();
+            record->from_ip     = packets[i].from_ip;
+            record->to_mcast_ip = packets[i].to_mcast_ip;
+            record->header      = headers[i];
+
+            used += CPacketArena::RecordSize(packets[i].bytes);
+            num_records++;
+            records[i] = record;
+         }
+      }
+
+      arena.Commit(used, num_records);
+
+      // Copy the large datagrams into records of their own
+      for (int i = 0; i < num_packets; i++)
+      {
+         if (records[i])
+            continue;
+
+         size_t size = CPacketArena::RecordSize(packets[i].bytes);
+         char*  space = arena.Reserve(size);
+
+         if (space)
+         {
+            records[i] = (TPacketRecord*)space;
+            records[i]->slab        = arena.CurrentSlab();
+            records[i]->from_ip     = packets[i].from_ip;
+            records[i]->to_mcast_ip = packets[i].to_mcast_ip;
+            records[i]->header      = headers[i];
+            memcpy(records[i]->Payload(), &large_buffer[i * MAX_BUFFER], packets[i].bytes);
+
+            arena.Commit(size, 1);
+         }
+         else
+         {
+            ring.AddOverflows(1);
+         }
+      }
+
+      // Hand the records to the writer in the order they were received
+      num_records = 0;
+      for (int i = 0; i < num_packets; i++)
+      {
+         if (!records[i])
+            continue;
+
+         if (logger.IsEnabled(LOG_PACKET))
+         {
+            inet_ntop(AF_INET, &packets[i].from_ip, from_ip, INET_ADDRSTRLEN);
+            inet_ntop(AF_INET, &packets[i].to_mcast_ip, from_mc, INET_ADDRSTRLEN);
+            logger.Log(LOG_PACKET, "Got message from %s (%s) bytes %d", from_ip, from_mc, packets[i].bytes);
+         }
+
+         *ring.WriteSlot(num_records++) = records[i];
+      }
+
+      ring.Commit(num_records);
+      ring.Notify();
+   }
+}
+
+// long options without a short form
+enum
+{
+   OPT_MAX_PPS = 256,
+   OPT_MAX_BPS,
+   OPT_METRICS_SOCKET,
+   OPT_METRICS_FILE,
+   OPT_RCVBUF,
+   OPT_SNDBUF,
+   OPT_RX_THREADS,
+   OPT_RX_CPUS,
+   OPT_CAPTURE,
+   OPT_INTERFACE,
+   OPT_EXPORT,
+   OPT_DEDUP,
+   OPT_DELTA,
+   OPT_BLACKBOX,
+   OPT_SEGMENT_SIZE,
+   OPT_DIRECT,
+   OPT_SYNC
+};
+
+// Parses a comma separated list of cores.  Fails on an empty list or an
+// entry that is not a core number below CPU_SETSIZE.
+bool parse_cpus(const char* Text, std::vector<int>& Cpus)
+{
+   std::stringstream list(Text);
+   std::string       cpu;
+   std::vector<int>  cpus;
+
+   while (std::getline(list, cpu, ','))
+   {
+      if (cpu.empty() || cpu.size() > 5 || cpu.find_first_not_of("0123456789") != std::string::npos)
+         return false;
+
+      int number = atoi(cpu.c_str());
+
+      if (number >= CPU_SETSIZE)
+         return false;
+
+      cpus.push_back(number);
+   }
+
+   if (cpus.empty())
+      return false;
+
+   Cpus = cpus;
+   return true;
+}
+
+// Parses a time in seconds, negative ones count back from the end
+bool parse_seconds(const char* Text, double& Seconds)
+{
+   char*  end;
+   double seconds = strtod(Text, &end);
+
+   if (end == Text || *end != '\0' || !std::isfinite(seconds))
+      return false;
+
+   Seconds = seconds;
+   return true;
+}
+
+// Parses a rate such as 20000, 1.5M or 10G.  Fails on anything else,
+// including negative rates.
+bool parse_rate(const char* Text, double& Rate)
+{
+   char*  end;
+   double rate = strtod(Text, &end);
+
+   if (end == Text || !std::isfinite(rate) || rate < 0.0)
+      return false;
+
+   switch (*end)
+   {
+      case 'k': case 'K': rate *= 1e3; end++; break;
+      case 'm': case 'M': rate *= 1e6; end++; break;
+      case 'g': case 'G': rate *= 1e9; end++; break;
+   }
+
+   if (*end != '\0')
+      return false;
+
+   Rate = rate;
+   return true;
+}
+
+// Parses a socket buffer size.  The kernel doubles it, so anything past
+// INT_MAX / 2 would wrap.
+bool parse_buffer_size(const char* Text, int& Bytes)
+{
+   double bytes;
+
+   if (!parse_rate(Text, bytes) || bytes > INT_MAX / 2)
+      return false;
+
+   Bytes = (int)bytes;
+   return true;
+}
+
+void usage()
+{
+   printf("Usage: main [options] [playback directory]\n");
+   printf("  -w, --writer=uring|pwritev   recording writer backend (default uring)\n");
+   printf("      --direct                 write recordings with O_DIRECT through aligned blocks\n");
+   printf("      --sync=BYTES|MSms        fdatasync the recording every BYTES written (k, M, G\n");
+   printf("                               suffixes) or every MS milliseconds, or never (the\n");
+   printf("                               default)\n");
+   printf("  -c, --container              record to one session container (.urec)\n");
+   printf("      --dedup                  write payloads a .bin file already holds as references\n");
+   printf("                               to the earlier copy (not with --container)\n");
+   printf("      --delta                  write payloads as XOR deltas against the one before\n");
+   printf("                               in their .bin file (not with --container)\n");
+   printf("      --blackbox=BYTES         keep only the last BYTES of traffic (k, M, G suffixes) in\n");
+   printf("                               reused segment files described by blackbox.manifest\n");
+   printf("      --segment-size=BYTES     black box segment size (default 64M, at most half\n");
+   printf("                               of the black box)\n");
+   printf("  -s, --start=SECONDS          start playback this far into the recording,\n");
+   printf("                               negative counts back from the end\n");
+   printf("  -e, --end=SECONDS            stop playback this far into the recording\n");
+   printf("  -H, --hosts=all|IP[,IP...]   play back these computers together instead of asking\n");
+   printf("  -T, --threads=N              playback sender threads (default 1)\n");
+   printf("  -C, --cpus=N[,N...]          cores to pin the sender threads to\n");
+   printf("  -t, --tx-sockets=N           sockets per sender thread (default 1)\n");
+   printf("  -x, --speed=FACTOR           playback speed, %g to %g (default 1)\n", MIN_SPEED, MAX_SPEED);
+   printf("  -F, --fast                   send as fast as possible, ignoring recorded timing\n");
+   printf("      --max-pps=RATE           cap playback at RATE packets/s (k, M, G suffixes)\n");
+   printf("      --max-bps=RATE           cap playback at RATE bits/s (k, M, G suffixes)\n");
+   printf("  -v, --verbosity=LEVEL        error, warning, info (default, a summary a second)\n");
+   printf("                               or packet (a line per packet)\n");
+   printf("  -p, --pacing=sleep|hybrid|spin\n");
+   printf("                               how playback waits for each packet (default hybrid)\n");
+   printf("      --capture=socket|packet  receive on UDP sockets (default) or capture from an\n");
+   printf("                               AF_PACKET ring, which needs CAP_NET_RAW\n");
+   printf("      --interface=NAME         interface to capture on (default the one with %s)\n", MY_IP_ADDRESS);
+   printf("      --rx-threads=N           recording receive threads, the groups are split\n");
+   printf("                               between them (default 1, at most %d)\n", CPacketRing<TPacketRecord*>::MAX_WAIT);
+   printf("      --rx-cpus=N[,N...]       cores to pin the receive threads to\n");
+   printf("      --rcvbuf=BYTES           recording socket receive buffer (k, M suffixes, up\n");
+   printf("                               to 1G), default net.core.rmem_default\n");
+   printf("      --sndbuf=BYTES           playback socket send buffer (k, M suffixes, up to 1G)\n");
+   printf("      --metrics-socket=PATH    serve live metrics on a Unix socket (nc -U PATH)\n");
+   printf("      --metrics-file=PATH      write the live metrics to PATH every second\n");
+   printf("      --export=FILE            write the playback streams to a pcapng capture in time\n");
+   printf("                               order instead of sending them (all computers unless\n");
+   printf("                               --hosts is given, --start/--end apply)\n");
+   printf("\nThe playback argument is a directory of .bin/.urec files, or a .urec or\n");
+   printf(".pcapng file\n");
+}
+
+int main(int argc, char* argv[])
+{
+   char time_str[50] = {};
+   bool record = true;
+   int  opt;
+
+   static const struct option long_options[] =
+   {
+      { "writer",     required_argument, 0, 'w' },
+      { "container",  no_argument,       0, 'c' },
+      { "start",      required_argument, 0, 's' },
+      { "end",        required_argument, 0, 'e' },
+      { "pacing",     required_argument, 0, 'p' },
+      { "tx-sockets", required_argument, 0, 't' },
+      { "hosts",      required_argument, 0, 'H' },
+      { "threads",    required_argument, 0, 'T' },
+      { "cpus",       required_argument, 0, 'C' },
+      { "speed",      required_argument, 0, 'x' },
+      { "fast",       no_argument,       0, 'F' },
+      { "verbosity",  required_argument, 0, 'v' },
+      { "max-pps",    required_argument, 0, OPT_MAX_PPS },
+      { "max-bps",    required_argument, 0, OPT_MAX_BPS },
+      { "metrics-socket", required_argument, 0, OPT_METRICS_SOCKET },
+      { "metrics-file",   required_argument, 0, OPT_METRICS_FILE },
+      { "capture",        required_argument, 0, OPT_CAPTURE },
+      { "interface",      required_argument, 0, OPT_INTERFACE },
+      { "rx-threads",     required_argument, 0, OPT_RX_THREADS },
+      { "rx-cpus",        required_argument, 0, OPT_RX_CPUS },
+      { "rcvbuf",         required_argument, 0, OPT_RCVBUF },
+      { "sndbuf",         required_argument, 0, OPT_SNDBUF },
+      { "export",         required_argument, 0, OPT_EXPORT },
+      { "dedup",          no_argument,       0, OPT_DEDUP },
+      { "delta",          no_argument,       0, OPT_DELTA },
+      { "blackbox",       required_argument, 0, OPT_BLACKBOX },
+      { "segment-size",   required_argument, 0, OPT_SEGMENT_SIZE },
+      { "direct",         no_argument,       0, OPT_DIRECT },
+      { "sync",           required_argument, 0, OPT_SYNC },
+      { "help",       no_argument,       0, 'h' },
+      { 0, 0, 0, 0 }
+   };
+
+   while ((opt = getopt_long(argc, argv, "w:cs:e:p:t:H:T:C:x:Fv:h", long_options, NULL)) != -1)
+   {
+      switch (opt)
+      {
+         case 'w':
+            if (strcmp(optarg, "uring") == 0)
+               writer_backend = WRITER_IO_URING;
+            else if (strcmp(optarg, "pwritev") == 0)
+               writer_backend = WRITER_PWRITEV;
+            else
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'c':
+            record_container = true;
+            break;
+
+         case 's':
+            if (!parse_seconds(optarg, playback_start))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'e':
+            if (!parse_seconds(optarg, playback_end))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 't':
+            num_tx_sockets = atoi(optarg);
+            if (num_tx_sockets < 1)
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'H':
+            playback_hosts = optarg;
+            break;
+
+         case 'T':
+            num_playback_threads = atoi(optarg);
+            if (num_playback_threads < 1)
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'C':
+            if (!parse_cpus(optarg, playback_cpus))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'x':
+            playback_speed = atof(optarg);
+            if (playback_speed < MIN_SPEED || playback_speed > MAX_SPEED)
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case 'F':
+            playback_fast = true;
+            break;
+
+         case 'v':
+         {
+            eLogLevel level;
+
+            if (!CLogger::ParseLevel(optarg, level))
+            {
+               usage();
+               return 1;
+            }
+
+            logger.SetLevel(level);
+            break;
+         }
+
+         case OPT_MAX_PPS:
+            if (!parse_rate(optarg, playback_max_pps))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_MAX_BPS:
+            if (!parse_rate(optarg, playback_max_bps))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_METRICS_SOCKET:
+            metrics_socket = optarg;
+            break;
+
+         case OPT_METRICS_FILE:
+            metrics_file = optarg;
+            break;
+
+         case OPT_CAPTURE:
+            if (strcmp(optarg, "socket") == 0)
+               capture_backend = CAPTURE_SOCKET;
+            else if (strcmp(optarg, "packet") == 0)
+               capture_backend = CAPTURE_PACKET;
+            else
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_INTERFACE:
+            capture_interface = optarg;
+            break;
+
+         case OPT_RX_THREADS:
+            num_record_threads = atoi(optarg);
+
+            // the writer sleeps on every receive thread's ring at once
+            if (num_record_threads < 1 || num_record_threads > CPacketRing<TPacketRecord*>::MAX_WAIT)
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_RX_CPUS:
+            if (!parse_cpus(optarg, record_cpus))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_RCVBUF:
+            if (!parse_buffer_size(optarg, socket_rcvbuf))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_SNDBUF:
+            if (!parse_buffer_size(optarg, socket_sndbuf))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         case OPT_EXPORT:
+            export_file = optarg;
+            break;
+
+         case OPT_DEDUP:
+            record_dedup = true;
+            break;
+
+         case OPT_DELTA:
+            record_delta = true;
+            break;
+
+         case OPT_BLACKBOX:
+         {
+            double bytes;
+
+            if (!parse_rate(optarg, bytes))
+            {
+               usage();
+               return 1;
+            }
+
+            blackbox_bytes = (uint64_t)bytes;
+            break;
+         }
+
+         case OPT_SEGMENT_SIZE:
+         {
+            double bytes;
+
+            if (!parse_rate(optarg, bytes))
+            {
+               usage();
+               return 1;
+            }
+
+            blackbox_segment_bytes = (uint64_t)bytes;
+            break;
+         }
+
+         case OPT_DIRECT:
+            writer_direct = true;
+            break;
+
+         case OPT_SYNC:
+         {
+            char*  end;
+            double value = strtod(optarg, &end);
+
+            sync_bytes = 0;
+            sync_interval = 0.0;
+
+            // MSms is an interval, anything else other than never is bytes
+            if (end != optarg && strcmp(end, "ms") == 0 && std::isfinite(value) && value > 0.0)
+               sync_interval = value / 1000.0;
+            else if (parse_rate(optarg, value) && value >= 1.0)
+               sync_bytes = (uint64_t)value;
+            else if (strcmp(optarg, "never") != 0)
+            {
+               usage();
+               return 1;
+            }
+            break;
+         }
+
+         case 'p':
+            if (!CPlaybackPacer::ParseMode(optarg, pace_mode))
+            {
+               usage();
+               return 1;
+            }
+            break;
+
+         default:
+            usage();
+            return 1;
+      }
+   }
+
+   // exporting needs a recording to convert
+   if (argc - optind > 1 || (!export_file.empty() && optind == argc))
+   {
+      usage();
+      return 1;
+   }
+
+   record = (optind == argc);
+
+   // the black box segments are containers
+   if (blackbox_bytes)
+      record_container = true;
+
+   // containers gather records into chunks, so their offsets are not known
+   // when a reference would need them
+   if ((record_dedup || record_delta) && record_container)
+   {
+      printf("Warning: --dedup and --delta do not apply to --container recordings\n");
+      record_dedup = false;
+      record_delta = false;
+   }
+
+   // stdout is buffered, the logger thread flushes it every few ms
+
+   if (record)
+   {
+      int num_cpus = std::thread::hardware_concurrency();
+
+      // the slabs are shared out between the receive threads, only pin when
+      // asked for cores or when there are several threads
+      for (int k = 0; k < num_record_threads; k++)
+      {
+         int cpu = -1;
+
+         if (!record_cpus.empty())
+            cpu = record_cpus[k % record_cpus.size()];
+         else if (num_record_threads > 1 && num_cpus > 0)
+            cpu = k % num_cpus;
+
+         record_shards.push_back(new TReceiveShard(k, cpu, std::max(NUM_SLABS / num_record_threads, MIN_SLABS)));
+      }
+   }
+
+   signal(SIGINT, int_handler);
+
+   if (record)
+   {
+      std::vector<CPacketRing<TPacketRecord*>*> rings;
+      std::vector<std::thread>                  receivers;
+      CRecordWriter                             writer;
+      CContainerWriter                          container(writer);
+      CBlackBox                                 blackbox(writer, container);
+      uint64_t                     prev_overflows = 0;
+      uint64_t                     prev_kernel_drops = 0;
+      double                       last_flush = CSimTimer::GetCurrentTime();
+      double                       last_summary = last_flush;
+      uint64_t                     summary_packets = 0;
+      uint64_t                     summary_bytes = 0;
+      CStreamMetricsTable          stream_metrics(MAX_STREAMS);
+      CLatencyHistogram            disk_latency;
+      CMetricsServer               metrics;
+      double                       record_start = last_flush;
+
+      // make hash map of writer files, keyed by source and group address.
+      // In a container the streams only keep their metrics.
+      struct TRecordStream
+      {
+         int             file = -1;
+         std::string     filename;
+         CTimeIndex      index;
+         TStreamMetrics* metrics = nullptr; // NULL once MAX_STREAMS are counted
+         CPayloadStore   payloads; // payloads already in the file, with --dedup
+         CDeltaEncoder   deltas;   // previous payload, with --delta
+      };
+
+      std::vector<char> delta_buffer(MAX_BUFFER);
+
+      std::unordered_map<uint64_t, TRecordStream> streams;
+
+      // writer state published for the metrics thread
+      struct TWriterGauges
+      {
+         std::atomic<uint32_t> in_flight{0};
+         std::atomic<uint64_t> backlog{0};
+         std::atomic<uint64_t> bytes_written{0};
+         std::atomic<uint64_t> writes{0};
+         std::atomic<uint64_t> errors{0};
+         std::atomic<uint64_t> synced{0};
+         std::atomic<uint64_t> at_risk{0};
+         std::atomic<uint64_t> max_at_risk{0};
+         std::atomic<double>   max_at_risk_s{0.0};
+      } writer_gauges;
+
+      writer.Open(writer_backend, WRITE_QUEUE, writer_direct);
+      writer.SetSyncPolicy(sync_bytes, sync_interval);
+      writer.SetLatencyHistogram(&disk_latency);
+
+      // open the output before the receive threads start, they are not
+      // joined if this fails
+      if (blackbox_bytes)
+      {
+         if (!blackbox.Open(blackbox_bytes, blackbox_segment_bytes))
+            return 1;
+         printf("Opened black box, %d segments of %lu bytes\n", blackbox.GetNumSegments(), blackbox.GetSegmentBytes());
+      }
+      else if (record_container)
+      {
+         char      filename[64];
+         time_t    now = time(NULL);
+         struct tm tm;
+
+         localtime_r(&now, &tm);
+         strftime(filename, sizeof(filename), "session_%Y%m%d_%H%M%S.urec", &tm);
+
+         printf("Opening container %s\n", filename);
+         if (!container.Open(filename))
+            return 1;
+      }
+
+      for (auto& shard : record_shards)
+      {
+         rings.push_back(&shard->ring);
+         receivers.emplace_back(record_thread, std::ref(*shard));
+      }
+
+      auto ring_overflows = [&]()
+      {
+         uint64_t overflows = 0;
+
+         for (auto& shard : record_shards)
+            overflows += shard->ring.Overflows();
+
+         return overflows;
+      };
+
+      // Hands one record to the writer, the writer releases it to the arena
+      // once it is on disk
+      auto write_record = [&](TPacketRecord* record, double now)
+      {
+         uint64_t key = ((uint64_t)record->from_ip.s_addr << 32) | record->to_mcast_ip.s_addr;
+         auto     stream = streams.find(key);
+
+         if (stream == streams.end())
+         {
+            TRecordStream entry;
+
+            entry.metrics = stream_metrics.Add(record->from_ip, record->to_mcast_ip);
+
+            if (!record_container)
+            {
+               char        from_ip[INET_ADDRSTRLEN] = {};
+               char        from_mc[INET_ADDRSTRLEN] = {};
+               std::string filename = "file_";
+
+               inet_ntop(AF_INET, &record->from_ip, from_ip, INET_ADDRSTRLEN);
+               inet_ntop(AF_INET, &record->to_mcast_ip, from_mc, INET_ADDRSTRLEN);
+
+               filename += from_ip;
+               filename += "_";
+               filename += from_mc;
+               filename += ".bin";
+
+               // open file
+               logger.Log(LOG_INFO, "Opening file %s", filename.c_str());
+               TRecordFileHeader file_header;
+               int               file = writer.OpenFile(filename.c_str());
+
+               if (file >= 0)
                {
-                  // open file
-                  printf("Opening file %s\n", filename.c_str());
-                  std::ofstream file(filename, std::ios::binary);
-                  streams[filename] = std::move(file);
+                  InitRecordFileHeader(file_header, (record_dedup || record_delta) ? RECORD_FILE_VERSION_V3 : RECORD_FILE_VERSION);
+                  writer.Append(file, &file_header, sizeof(file_header));
                }
 
-               // write data to file
-               streams[filename].write((const char*)&local_data[i].time, sizeof(local_data[i].time));
-               streams[filename].write((const char*)&local_data[i].bytes, sizeof(local_data[i].bytes));
-               streams[filename].write(local_data[i].buffer, local_data[i].bytes);
+               entry.file = file;
+               entry.filename = filename;
+               entry.index.Reset(sizeof(file_header));
+            }
+
+            stream = streams.emplace(key, std::move(entry)).first;
+         }
+
+         if (stream->second.metrics)
+            stream->second.metrics->Count(record->header.bytes);
+
+         if (blackbox_bytes)
+         {
+            blackbox.Append(record, now);
+            return;
+         }
+         else if (record_container)
+         {
+            container.Append(record, now);
+            return;
+         }
+
+         // header and payload are contiguous in the arena
+         if (stream->second.file >= 0)
+         {
+            TRecordStream& entry = stream->second;
+            uint64_t       offset = writer.GetOffset(entry.file);
+            uint64_t       bytes = record->header.bytes;
+            uint64_t       found = 0;
+            uint64_t       encoded = 0;
+
+            // A payload the file already holds is written as a reference to
+            // it, one that differs a little from the one before as a delta
+            // against it (but whole where the index will point), both in
+            // place of the payload
+            bool reference = record_dedup && entry.payloads.Find(record->Payload(), bytes, found);
+            bool delta = record_delta &&
+                         entry.deltas.Encode(record->Payload(), bytes, reference || entry.index.StartsEntry(record->header.time, offset),
+                            delta_buffer.data(), encoded);
+
+            if (reference)
+            {
+               TRecordReference reference = { found };
+
+               memcpy(record->Payload(), &reference, sizeof(reference));
+               record->header.bytes |= RECORD_REFERENCE;
+            }
+            else if (delta)
+            {
+               memcpy(record->Payload(), delta_buffer.data(), encoded);
+               record->header.bytes = encoded | RECORD_DELTA;
+            }
+            else if (record_dedup)
+            {
+               entry.payloads.Add(record->Payload(), bytes, offset + sizeof(TRecordHeader));
+            }
+
+            entry.index.Add(record->header.time, offset, !delta);
+            writer.Append(entry.file, record);
+         }
+         else
+         {
+            record->slab->arena->Release(record);
+         }
+      };
+
+      CSimTimer::GetCurrentTimeStr(time_str);
+      printf("%s: Recording traffic on %s:%d, from .1-.%d (%s writer)\n", time_str, BASE_MC_ADDRESS, PORT, NUM_MC_ADDRESSES, writer.GetBackendName());
+
+      auto format_metrics = [&](std::string& text, double now)
+      {
+         AppendMetric(text, "mode record\n");
+         AppendMetric(text, "uptime_s %.1f\n", now - record_start);
+         AppendMetric(text, "packets_total %lu\n", total_packets_recorded.load(std::memory_order_relaxed));
+         AppendMetric(text, "bytes_total %lu\n", stream_metrics.GetBytes());
+         AppendMetric(text, "receive_threads %ld\n", record_shards.size());
+         AppendMetric(text, "ring_overflows %lu\n", ring_overflows());
+
+         for (auto& shard : record_shards)
+            AppendMetric(text, "ring %d depth %u high_water %u capacity %u overflows %lu\n", shard->id,
+               shard->ring.Depth(), shard->ring.HighWater(), shard->ring.Capacity(), shard->ring.Overflows());
+
+         AppendMetric(text, "kernel_drops %lu\n", kernel_drops.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_in_flight %u\n", writer_gauges.in_flight.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_backlog_bytes %lu\n", writer_gauges.backlog.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_bytes_written %lu\n", writer_gauges.bytes_written.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_writes %lu\n", writer_gauges.writes.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_errors %lu\n", writer_gauges.errors.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_synced_bytes %lu\n", writer_gauges.synced.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_at_risk_bytes %lu\n", writer_gauges.at_risk.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_max_at_risk_bytes %lu\n", writer_gauges.max_at_risk.load(std::memory_order_relaxed));
+         AppendMetric(text, "writer_max_at_risk_s %.3f\n", writer_gauges.max_at_risk_s.load(std::memory_order_relaxed));
+
+         TLatencySnapshot latency;
+
+         latency.Add(disk_latency);
+         latency.Format(text, "receive_to_disk");
+         stream_metrics.Format(text, now);
+      };
+
+      if (!metrics_socket.empty() || !metrics_file.empty())
+         metrics.Open(metrics_socket, metrics_file, format_metrics);
+
+      logger.Start();
+
+      // Hands what the receive threads queued to the writer, a ring at a time
+      // so the packets of each stream stay in order
+      auto drain_rings = [&](double now)
+      {
+         uint32_t total = 0;
+
+         for (auto& shard : record_shards)
+         {
+            CPacketRing<TPacketRecord*>& ring = shard->ring;
+            uint32_t                     num_packets = ring.ReadAvailable();
+
+            for (uint32_t i = 0; i < num_packets; i++)
+            {
+               TPacketRecord* record = *ring.ReadSlot(i);
+
+               summary_bytes += record->header.bytes;
+               write_record(record, now);
+            }
+
+            ring.Release(num_packets);
+            shard->arena.Flush();
+            total += num_packets;
+         }
+
+         // counted here, the receive threads would all be writing it
+         total_packets_recorded.store(total_packets_recorded.load(std::memory_order_relaxed) + total, std::memory_order_relaxed);
+
+         return total;
+      };
+
+      while (record_running)
+      {
+         double now = CSimTimer::GetCurrentTime();
+
+         writer_gauges.in_flight.store(writer.GetInFlight(), std::memory_order_relaxed);
+         writer_gauges.backlog.store(writer.GetBytesQueued() - writer.GetBytesCompleted(), std::memory_order_relaxed);
+         writer_gauges.bytes_written.store(writer.GetBytesWritten(), std::memory_order_relaxed);
+         writer_gauges.writes.store(writer.GetWrites(), std::memory_order_relaxed);
+         writer_gauges.errors.store(writer.GetErrors(), std::memory_order_relaxed);
+         writer_gauges.synced.store(writer.GetBytesSynced(), std::memory_order_relaxed);
+         writer_gauges.at_risk.store(writer.GetBytesAtRisk(), std::memory_order_relaxed);
+         writer_gauges.max_at_risk.store(writer.GetMaxBytesAtRisk(), std::memory_order_relaxed);
+         writer_gauges.max_at_risk_s.store(writer.GetMaxTimeAtRisk(), std::memory_order_relaxed);
+
+         // one line a second instead of one per packet
+         if (now - last_summary >= 1.0)
+         {
+            if (summary_packets)
+               logger.Log(LOG_INFO, "Recorded %lu packets, %.2f Mbit/s, %ld streams", summary_packets,
+                  summary_bytes * 8.0 / (now - last_summary) / 1e6, record_container ? (long)container.GetNumStreams() : (long)streams.size());
+
+            // at most one warning a second, a full buffer drops in bursts
+            if (kernel_drops.load(std::memory_order_relaxed) != prev_kernel_drops)
+            {
+               uint64_t drops = kernel_drops.load(std::memory_order_relaxed);
+
+               logger.Log(LOG_WARNING, "Receive buffer full, %lu packets dropped by the kernel", drops - prev_kernel_drops);
+               prev_kernel_drops = drops;
             }
+
+            last_summary = now;
+            summary_packets = 0;
+            summary_bytes = 0;
+         }
+
+         if (blackbox_bytes)
+            blackbox.Service(now);
+
+         writer.Service(now);
+
+         uint32_t num_packets = drain_rings(now);
+
+         if (num_packets == 0)
+         {
+            // nothing new, push out whatever is still being coalesced
+            container.Service(now);
+            writer.Submit(true);
+            writer.Reap(false);
+            last_flush = now;
+
+            CPacketRing<TPacketRecord*>::WaitAny(rings.data(), rings.size(), writer.GetInFlight() ? 1 : 100);
+            continue;
+         }
+
+         summary_packets += num_packets;
+
+         writer.Submit(false);
+
+         if (now - last_flush > WRITE_FLUSH_MS / 1000.0)
+         {
+            container.Service(now);
+            writer.Submit(true);
+            last_flush = now;
          }
 
-         local_data.clear();
+         writer.Reap(false);
 
-         usleep(1000);
+         if (ring_overflows() != prev_overflows)
+         {
+            logger.Log(LOG_WARNING, "Writer falling behind, %lu packets dropped", ring_overflows() - prev_overflows);
+            prev_overflows = ring_overflows();
+         }
       }
 
+      // write out what the receive threads already handed over
+      drain_rings(CSimTimer::GetCurrentTime());
+
+      metrics.Close();
+      logger.Stop();
+
       CSimTimer::GetCurrentTimeStr(time_str);
-      printf("\n%s: %d packets recorded to %ld files\n", time_str, total_packets_recorded, streams.size());
+      if (blackbox_bytes)
+         printf("\n%s: %lu packets recorded to a black box of %d segments, %lu reused\n", time_str, total_packets_recorded.load(), blackbox.GetNumSegments(), blackbox.GetReuses());
+      else if (record_container)
+         printf("\n%s: %lu packets recorded to %d streams in %d chunks\n", time_str, total_packets_recorded.load(), container.GetNumStreams(), container.GetNumChunks());
+      else
+         printf("\n%s: %lu packets recorded to %ld files\n", time_str, total_packets_recorded.load(), streams.size());
+      for (auto& shard : record_shards)
+         printf("Packet ring %d: %lu packets dropped, high water %u of %u\n", shard->id,
+            shard->ring.Overflows(), shard->ring.HighWater(), shard->ring.Capacity());
+      printf("Kernel: %lu packets dropped%s\n", kernel_drops.load(), kernel_drops ? ", the recording is lossy" : "");
+
+      if (blackbox_bytes)
+         blackbox.Close();
+      else
+         container.Close();
+      writer.Close();
+
+      // save the time index next to each file for seeking during playback
+      for (const auto& stream : streams)
+      {
+         if (stream.second.file >= 0 &&
+             !stream.second.index.Save(CTimeIndex::GetFilename(stream.second.filename), writer.GetOffset(stream.second.file)))
+            printf("Warning: could not save the time index of %s\n", stream.second.filename.c_str());
+      }
+
+      double record_time = CSimTimer::GetCurrentTime() - record_start;
+
+      printf("Writer (%s%s): %lu bytes in %lu writes, %.1f MB/s, %u in flight max, %lu errors\n", writer.GetBackendName(),
+         writer.IsDirect() ? ", O_DIRECT" : "", writer.GetBytesWritten(), writer.GetWrites(),
+         record_time > 0.0 ? writer.GetBytesCompleted() / record_time / 1e6 : 0.0, writer.GetMaxInFlight(), writer.GetErrors());
+      printf("Sync: %lu syncs, %lu of %lu bytes synced, at most %lu bytes and %.3f s of data at risk\n", writer.GetSyncs(),
+         writer.GetBytesSynced(), writer.GetBytesCompleted(), writer.GetMaxBytesAtRisk(), writer.GetMaxTimeAtRisk());
+
+      if (record_dedup)
+      {
+         uint64_t references = 0;
+         uint64_t saved = 0;
+
+         for (const auto& stream : streams)
+         {
+            references += stream.second.payloads.GetReferences();
+            saved += stream.second.payloads.GetBytesSaved();
+         }
+
+         printf("Dedup: %lu payloads written as references, %lu bytes saved\n", references, saved);
+      }
+
+      if (record_delta)
+      {
+         uint64_t deltas = 0;
+         uint64_t saved = 0;
+
+         for (const auto& stream : streams)
+         {
+            deltas += stream.second.deltas.GetDeltas();
+            saved += stream.second.deltas.GetBytesSaved();
+         }
+
+         printf("Delta: %lu payloads written as deltas, %lu bytes saved\n", deltas, saved);
+      }
       printf("Exiting...\n");
 
       // wait on thread to exit
-      // NOTE: Thread blocks on socket read, so just exit without waiting
-      // record.join();
+      // NOTE: Threads block on socket read, so just exit without waiting
+      for (auto& receiver : receivers)
+         receiver.detach();
    }
    else
    {
-      playback(argv[1]);
+      logger.Start();
+
+      if (export_file.empty())
+         playback(argv[optind]);
+      else
+         export_pcapng(argv[optind]);
+
+      logger.Stop();
    }
 
 }
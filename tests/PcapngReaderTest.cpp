@@ -0,0 +1,279 @@
+//-----------------------------------------------------------------------------
+//                               UNCLASSIFIED
+//-----------------------------------------------------------------------------
+//                    DO NOT REMOVE OR MODIFY THIS HEADER
+//-----------------------------------------------------------------------------
+//  This software and the accompanying documentation are provided to the U.S.
+//  Government with unlimited rights as provided in DFARS section 252.227-7014.
+//  The contractor, Veraxx Engineering Corporation, retains ownership, the
+//  copyrights, and all other rights.
+//
+//  Copyright Veraxx Engineering Corporation 2023.  All rights reserved.
+//
+// DEVELOPED BY:
+//  Veraxx Engineering Corporation
+//  14130 Sullyfield Circle Ste. B
+//  Chantilly, VA 20151
+//  (703)880-9000 (Voice)
+//  (703)880-9005 (Fax)
+//-----------------------------------------------------------------------------
+//  Title:      Pcapng Reader Test
+//  Class:      C++ Source
+//  Filename:   PcapngReaderTest.cpp
+//  Author:     Brian Woodard
+//  Purpose:    This module performs the following tasks:
+//
+//              Checks CPcapngIndex and CPcapngStreamReader against
+//              ten_capture.pcapng (packet and byte counts and an FNV-1a hash
+//              of the payloads of every stream, from an independent parse)
+//              and checks that multicast datagrams to other ports, such as
+//              mDNS, are not played.  Run from the top of the tree with
+//              "make test".
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <vector>
+#include "../PcapngReader.h"
+
+// the stream readers bring in the rest of the recording code
+#include "../SimTimer.cpp"
+#include "../PacketArena.cpp"
+#include "../IoUring.cpp"
+#include "../RecordWriter.cpp"
+#include "../Container.cpp"
+#include "../MappedFile.cpp"
+#include "../DeltaCodec.cpp"
+#include "../TimeIndex.cpp"
+#include "../RecordReader.cpp"
+#include "../PcapngReader.cpp"
+
+const uint16_t PORT = 4000;
+
+struct TExpectedStream
+{
+   const char* from_ip;
+   const char* to_mcast_ip;
+   uint64_t    packets;
+   uint64_t    bytes;
+   uint64_t    hash; // FNV-1a of the payloads in order
+};
+
+int failures = 0;
+
+void check(bool Condition, const char* What)
+{
+   if (!Condition)
+   {
+      printf("FAIL: %s\n", What);
+      failures++;
+   }
+}
+
+uint64_t fnv1a(uint64_t Hash, const char* Data, size_t Bytes)
+{
+   for (size_t i = 0; i < Bytes; i++)
+      Hash = (Hash ^ (uint8_t)Data[i]) * 0x100000001b3ull;
+
+   return Hash;
+}
+
+// Finds the stream from From to Group, NULL if the index has none
+const TPcapngStream* find_stream(const CPcapngIndex& Index, const char* From, const char* Group)
+{
+   for (const auto& stream : Index.GetStreams())
+   {
+      if (stream.from_ip.s_addr == inet_addr(From) && stream.to_mcast_ip.s_addr == inet_addr(Group))
+         return &stream;
+   }
+
+   return nullptr;
+}
+
+void test_ten_capture()
+{
+   static const TExpectedStream expected[] =
+   {
+      { "192.168.137.129", "229.7.7.1", 21, 1842, 0x181116ee85c117e2ull },
+      { "192.168.137.129", "229.7.7.100", 1039, 100568, 0x1922b13543ce5521ull },
+      { "192.168.137.129", "229.7.7.2", 9, 12593, 0x2e95043c6ff6907cull },
+      { "192.168.137.129", "229.7.7.45", 6, 378, 0x871a2104ac559ba6ull },
+      { "192.168.137.129", "229.7.7.53", 3, 196, 0x19cac1ce991b0cfeull },
+      { "192.168.137.129", "229.7.7.49", 1, 66, 0x3fcb0a9589be6a13ull },
+      { "192.168.137.129", "229.7.7.57", 2, 176, 0xe3819d2bce091214ull },
+      { "192.168.137.129", "229.7.7.205", 5, 305, 0xa46e8abb6a98657aull },
+      { "192.168.137.129", "229.7.7.222", 5, 305, 0x4bd2213578aadc38ull },
+      { "192.168.137.129", "229.7.7.46", 1, 197, 0x6ee7b2b2b3b67177ull },
+   };
+   CPcapngIndex index;
+
+   if (!index.Load("ten_capture.pcapng", PORT))
+   {
+      check(false, "ten_capture.pcapng loads");
+      return;
+   }
+
+   check(index.GetStreams().size() == sizeof(expected) / sizeof(expected[0]), "ten_capture.pcapng has 10 streams");
+
+   for (const auto& stream : expected)
+   {
+      const TPcapngStream* found = find_stream(index, stream.from_ip, stream.to_mcast_ip);
+      CPcapngStreamReader  reader;
+      TPlaybackRecord      record;
+      uint64_t             packets = 0;
+      uint64_t             bytes = 0;
+      uint64_t             hash = 0xcbf29ce484222325ull;
+      double               last_time = 0.0;
+      bool                 in_order = true;
+      std::vector<double>  times;
+
+      if (!found || !reader.Open(index, found->stream_id))
+      {
+         printf("FAIL: stream %s to %s not found\n", stream.from_ip, stream.to_mcast_ip);
+         failures++;
+         continue;
+      }
+
+      while (reader.Next(record))
+      {
+         in_order = in_order && record.time >= last_time;
+         last_time = record.time;
+         times.push_back(record.time);
+         packets++;
+         bytes += record.bytes;
+         hash = fnv1a(hash, record.payload, record.bytes);
+      }
+
+      if (packets != stream.packets || bytes != stream.bytes || hash != stream.hash || !in_order || found->num_packets != stream.packets)
+      {
+         printf("FAIL: stream %s to %s: %lu packets, %lu bytes, hash %016lx, expected %lu, %lu, %016lx\n", stream.from_ip,
+            stream.to_mcast_ip, packets, bytes, hash, stream.packets, stream.bytes, stream.hash);
+         failures++;
+      }
+
+      // seeking to the middle packet plays it and everything after it
+      if (!times.empty())
+      {
+         double   middle = times[times.size() / 2];
+         uint64_t remaining = 0;
+         bool     after = true;
+
+         check(reader.Seek(middle), "seek within a stream");
+
+         while (reader.Next(record))
+         {
+            after = after && record.time >= middle;
+            remaining++;
+         }
+
+         check(after && remaining == (uint64_t)(times.end() - std::lower_bound(times.begin(), times.end(), middle)),
+            "seek lands on the first packet at the time");
+      }
+   }
+}
+
+// Appends a block with its length at both ends
+void add_block(std::string& File, uint32_t Type, const std::string& Body)
+{
+   uint32_t length = 12 + ((Body.size() + 3) & ~3u);
+
+   File.append((const char*)&Type, 4);
+   File.append((const char*)&length, 4);
+   File.append(Body);
+   File.append(length - 12 - Body.size(), '\0');
+   File.append((const char*)&length, 4);
+}
+
+// Appends an Ethernet enhanced packet block holding one UDP datagram
+void add_datagram(std::string& File, const char* From, const char* Group, uint16_t Port, const std::string& Payload)
+{
+   std::string packet(14 + 20 + 8, '\0');
+   uint32_t    from = inet_addr(From);
+   uint32_t    group = inet_addr(Group);
+   uint16_t    ip_length = htons(20 + 8 + Payload.size());
+   uint16_t    udp_length = htons(8 + Payload.size());
+   uint16_t    port = htons(Port);
+   uint32_t    header[5] = { 0, 0, 0, 0, 0 };
+
+   packet[12] = 0x08;
+   packet[14] = 0x45;
+   memcpy(&packet[16], &ip_length, 2);
+   packet[14 + 8] = 32;
+   packet[14 + 9] = 17;
+   memcpy(&packet[14 + 12], &from, 4);
+   memcpy(&packet[14 + 16], &group, 4);
+   memcpy(&packet[34 + 2], &port, 2);
+   memcpy(&packet[34 + 4], &udp_length, 2);
+   packet += Payload;
+
+   header[3] = header[4] = packet.size();
+   add_block(File, 6, std::string((const char*)header, sizeof(header)) + packet);
+}
+
+void test_other_ports()
+{
+   const char* filename = "/tmp/pcapng_reader_test.pcapng";
+   std::string file;
+   uint32_t    section[4] = { 0x1A2B3C4D, 1, 0xffffffff, 0xffffffff };
+   uint32_t    interface[2] = { 1, 0 };
+   FILE*       output;
+   CPcapngIndex index;
+
+   add_block(file, 0x0A0D0D0A, std::string((const char*)section, sizeof(section)));
+   add_block(file, 1, std::string((const char*)interface, sizeof(interface)));
+   add_datagram(file, "10.0.0.1", "224.0.0.251", 5353, "mdns");
+   add_datagram(file, "10.0.0.1", "229.7.7.1", PORT, "recorded");
+   add_datagram(file, "10.0.0.1", "239.255.255.250", 1900, "ssdp");
+   add_datagram(file, "10.0.0.1", "229.7.7.1", PORT + 1, "other");
+
+   output = fopen(filename, "wb");
+
+   if (!output || fwrite(file.data(), file.size(), 1, output) != 1)
+   {
+      check(false, "test capture written");
+      return;
+   }
+
+   fclose(output);
+
+   check(index.Load(filename, PORT), "test capture loads");
+   check(index.GetStreams().size() == 1, "only the stream to PORT is found");
+   check(index.GetSkipped() == 3, "the datagrams to other ports are skipped");
+
+   if (index.GetStreams().size() == 1)
+   {
+      CPcapngStreamReader reader;
+      TPlaybackRecord     record;
+      int                 packets = 0;
+
+      reader.Open(index, index.GetStreams()[0].stream_id);
+
+      while (reader.Next(record))
+      {
+         check(record.bytes == 8 && memcmp(record.payload, "recorded", 8) == 0, "only the recorded datagram is played");
+         packets++;
+      }
+
+      check(packets == 1, "one datagram is played");
+   }
+
+   remove(filename);
+}
+
+int main()
+{
+   test_ten_capture();
+   test_other_ports();
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("All pcapng reader checks passed\n");
+   return 0;
+}